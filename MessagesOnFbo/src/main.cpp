@@ -2,7 +2,14 @@
 #include "ofApp.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
+	// Bake the textures on the CPU, for machines without a GPU.
+	if (argc > 1 && std::string(argv[1]) == "--headless") {
+		ofApp app;
+		app.bake(1024, 768);
+		return 0;
+	}
+
 	ofSetupOpenGL(1024,768,OF_FULLSCREEN);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
@@ -65,6 +65,39 @@ void ofApp::populateFbo(ofFbo &fbo, std::vector<string> msgs, ofTrueTypeFont fon
   fbo.end();
 }
 
+void ofApp::populateRaster(SoftRaster &raster, std::vector<string> msgs, const SoftFont &font, int width, int height) {
+  raster.allocate(width, height);
+  raster.clear(ofColor(0));
+  for (auto m : msgs) {
+    // Same random sequence as populateFbo.
+    glm::vec2 loc = glm::vec2(ofRandom(5, width-100), ofRandom(5, height));
+    ofColor c = ofColor::fromHsb(ofRandom(255), 255, 255);
+    auto deg = ofRandom(-60, 60);
+    raster.drawString(font, m, loc, deg, ofColor(c, 175));
+  }
+  raster.render();
+}
+
+void ofApp::bake(int width, int height) {
+  // Fixed seed so the hashes can be compared between runs.
+  ofSeedRandom(0);
+  
+  SoftFont font;
+  SoftRaster raster;
+  
+  font.load("caviar.ttf", 30);
+  readFile("amay.txt", amay);
+  populateRaster(raster, amay, font, width, height);
+  ofSaveImage(raster.getPixels(), "amay.png");
+  std::cout << "amay.png " << ofToHex(raster.getHash()) << std::endl;
+  
+  font.load("marvelos.otf", 25);
+  readFile("azra.txt", azra);
+  populateRaster(raster, azra, font, width, height);
+  ofSaveImage(raster.getPixels(), "azra.png");
+  std::cout << "azra.png " << ofToHex(raster.getHash()) << std::endl;
+}
+
 void ofApp::readFile(string fileName, std::vector<string> &array) {
   auto buffer = ofBufferFromFile(fileName);
   auto lines = ofSplitString(buffer.getText(), "\n");
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ofMain.h"
+#include "SoftRaster.h"
 
 class ofApp : public ofBaseApp{
 
@@ -12,6 +13,10 @@ class ofApp : public ofBaseApp{
 		void keyPressed(int key);
     void readFile(string fileName, std::vector<string> &array);
     void populateFbo(ofFbo &fbo, std::vector<string> array, ofTrueTypeFont font);
+    void populateRaster(SoftRaster &raster, std::vector<string> array, const SoftFont &font, int width, int height);
+  
+    // Render both textures on the CPU and save them (no window, no GL).
+    void bake(int width, int height);
   
     // Amay's messages.
     std::vector<string> amay;
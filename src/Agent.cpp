@@ -1,16 +1,28 @@
 #include "Agent.h"
+#include "Snapshot.h"
+#include "Params.h"
+#include <set>
 
 void Agent::setup(ofxBox2d &box2d, AgentProperties agentProps, string fileName) {
   font.load("opensansbold.ttf", 25);
+  messageFile = fileName;
   
-  // Prepare the agent's texture.
+  // Prepare the agent's texture. A seeded layout can come out of the texture cache.
+  textureSeed = agentProps.textureSeed;
+  cpuTexture = agentProps.cpuTexture;
+  if (textureSeed >= 0) {
+    ofSeedRandom(textureSeed);
+  }
   readFile(fileName);
   assignMessages(agentProps.meshSize);
   
-  // Initialize the iterator.
-  curMsg = messages.begin(); // Need the message to draw
+  // Initialize the handle.
+  curMsg = messages.size() > 0 ? 0 : -1; // Need the message to draw
   
   createTexture(agentProps.meshSize);
+  if (textureSeed >= 0) {
+    ofSeedRandom(); // Back to random for everything else.
+  }
   
   // Prepare agent's mesh.
   createMesh(agentProps);
@@ -31,27 +43,71 @@ void Agent::setup(ofxBox2d &box2d, AgentProperties agentProps, string fileName)
   applyTickle = false;
   applyAttraction = false;
   applyRepulsion = false; 
+  behaviors.start(StretchBehavior, [this] { return stretch(); });
+  lastBehaviorTime = SimClock::instance().getTime();
   
   // Current desire state. 
   desireState = None;
+  
+  // Start with full detail.
+  lodLevel = Near;
+  lodFrame = 0;
+  lodIdleFrames = 0;
+  lodStart = 0;
+  lodStride = 1;
 }
 
 void Agent::update() {
+  updateLod();
+  
+  // Proxy is frozen, so the mesh and the behaviors don't change.
+  if (lodLevel == Proxy) {
+    return;
+  }
+  
   // Use box2d circle to update the mesh.
   updateMesh();
   
-  // Print the velocity of vertices.
-  for (auto &v : vertices) {
-    auto vel = v->getVelocity().length();
-    if (vel > maxVelocity) {
-      // Normalize current velocity and multiply it by 20
-      auto n = v->getVelocity().normalize();
-      n = n * maxVelocity; // Max velocity weight
-      v->setVelocity(n.x, n.y);
+  // Far away agents only update every few frames on a subset of vertices.
+  lodFrame++;
+  if (lodLevel == Far) {
+    if (lodFrame % lodProps.frameInterval != 0) {
+      return;
+    }
+    lodStride = lodProps.vertexStride;
+    lodStart = (lodFrame / lodProps.frameInterval) % lodStride;
+  } else {
+    lodStride = 1;
+    lodStart = 0;
+  }
+  
+  auto start = ofGetElapsedTimeMicros();
+  if (batchForces) {
+    forces.begin(vertices);
+    // Packed and vectorized, so all the vertices (cheaper than going through the stride).
+    if (!limitInStep) {
+      forces.clampVelocities(maxVelocity);
+    }
+  } else if (!limitInStep) {
+    // Print the velocity of vertices.
+    for (int i = lodStart; i < vertices.size(); i += lodStride) {
+      auto &v = vertices[i];
+      auto vel = v->getVelocity().length();
+      if (vel > maxVelocity) {
+        // Normalize current velocity and multiply it by 20
+        auto n = v->getVelocity().normalize();
+        n = n * maxVelocity; // Max velocity weight
+        v->setVelocity(n.x, n.y);
+      }
     }
   }
   
   applyBehaviors();
+  
+  if (batchForces) {
+    forces.apply();
+  }
+  behaviorTime = (ofGetElapsedTimeMicros() - start) / 1000.f;
 }
 
 void Agent::draw(bool debug, bool showTexture) {
@@ -69,9 +125,9 @@ void Agent::draw(bool debug, bool showTexture) {
   ofPopStyle();
   
   if (showTexture) {
-    secondFbo.getTexture().bind();
-    mesh.draw();
-    secondFbo.getTexture().unbind();
+    textureFbo->getTexture().bind();
+    gridMesh.draw(mesh.getVertices());
+    textureFbo->getTexture().unbind();
   } else {
     ofPushStyle();
     for(auto j: joints) {
@@ -88,7 +144,8 @@ void Agent::draw(bool debug, bool showTexture) {
     ofPushMatrix();
       ofTranslate(centroid);
       ofNoFill();
-      ofSetColor(ofColor::white);
+      // White when near, grey when far, dark grey as a proxy.
+      ofSetColor(lodLevel == Near ? ofColor::white : (lodLevel == Far ? ofColor(150) : ofColor(70)));
       ofDrawCircle(0, 0, desireRadius);
     ofPopMatrix();
   }
@@ -96,41 +153,54 @@ void Agent::draw(bool debug, bool showTexture) {
 
 void Agent::assignIndices(AgentProperties agentProps) {
   // Store the corner indices in this array to access it when applying forces.
-  auto rows = agentProps.meshDimensions.x; auto cols = agentProps.meshDimensions.y;
+  int rows = agentProps.meshDimensions.x; int cols = agentProps.meshDimensions.y;
 
   // Corners
-  cornerIndices[0] = 0; cornerIndices[1] = (cols-1) + 0 * (cols-1);
-  cornerIndices[2] = 0 + (rows-1) * (cols-1); cornerIndices[3] = (cols-1) + (rows-1) * (cols-1);
+  cornerIndices[0] = 0; cornerIndices[1] = (cols-1) + 0 * cols;
+  cornerIndices[2] = 0 + (rows-1) * cols; cornerIndices[3] = (cols-1) + (rows-1) * cols;
   
   // Boundaries.
+  boundaryIndices.clear();
   
   // TOP
   int x; int y = 0;
-  for (x = 0; x < cols-1; x++) {
-    int idx = x + y * (cols-1);
+  for (x = 0; x < cols; x++) {
+    int idx = x + y * cols;
     boundaryIndices.push_back(idx);
   }
   
   // BOTTOM
   y = rows-1;
-  for (x = 0; x < cols-1; x++) {
-    int idx = x + y * (cols-1);
+  for (x = 0; x < cols; x++) {
+    int idx = x + y * cols;
     boundaryIndices.push_back(idx);
   }
   
-  // LEFT
+  // LEFT (corners are already in)
   x = 0;
-  for (y = 0; y < rows-1; y++) {
-    int idx = x + y * (cols-1);
+  for (y = 1; y < rows-1; y++) {
+    int idx = x + y * cols;
     boundaryIndices.push_back(idx);
   }
   
   // RIGHT
   x = cols-1;
-  for (y = 0; y < rows-1; y++) {
-    int idx = x + y * (cols-1);
+  for (y = 1; y < rows-1; y++) {
+    int idx = x + y * cols;
     boundaryIndices.push_back(idx);
   }
+  
+  // Boundary is always simulated, so store body indices (same as mesh indices
+  // when every vertex is simulated).
+  for (auto &idx : boundaryIndices) {
+    idx = meshToBody[idx];
+  }
+  
+  // Flag the boundary vertices, so the interior can be disabled for the proxy body.
+  for (auto idx : boundaryIndices) {
+    auto data = reinterpret_cast<VertexData*>(vertices[idx]->getData());
+    data->isBoundary = true;
+  }
 }
 
 void Agent::readFile(string fileName) {
@@ -151,15 +221,65 @@ void Agent::readFile(string fileName) {
 }
 
 ofPoint Agent::getTextureSize() {
-  return ofPoint(secondFbo.getWidth(), secondFbo.getHeight());
+  // No fbo after clean, the next texture gets the mesh size.
+  if (!textureFbo) {
+    return softBodyProps.meshSize;
+  }
+  return ofPoint(textureFbo->getWidth(), textureFbo->getHeight());
+}
+
+size_t Agent::getGpuBytes() {
+  return textureFbo ? FboPool::getBytes(textureFbo->getWidth(), textureFbo->getHeight()) : 0;
+}
+
+int Agent::getNumTextMessages() {
+  return numTextMessages;
+}
+
+size_t Agent::getCpuBytes() {
+  size_t bytes = messages.getBytes(); // Strings are shared, in the StringPool.
+  bytes += mesh.getVertices().capacity() * sizeof(glm::vec3);
+  if (softFilterChain) {
+    bytes += softFilterChain->getBytes();
+  }
+  return bytes;
 }
 
 void Agent::clean(ofxBox2d &box2d) {
+  // CPU filters hold on to their lookup tables and textures.
+  delete softFilterChain;
+  softFilterChain = NULL;
+  
+  // Texture goes to the next agent of this size.
+  if (textureFbo) {
+    FboPool::instance().release(textureFbo);
+    textureFbo.reset();
+  }
+  
+  // Park the lattice for the next agent with the same properties. Refined lattices
+  // have a different topology, so those are always destroyed.
+  bool isRefined = std::find(refinedCells.begin(), refinedCells.end(), true) != refinedCells.end();
+  if (!isRefined && world == box2d.getWorld()) {
+    // Inactive bodies are out of the broadphase and the solver, and so are their joints.
+    for (auto &v : vertices) {
+      v->body->SetActive(false);
+    }
+    
+    SoftBodyLattice lattice;
+    lattice.key = softBodyKey;
+    lattice.world = world;
+    lattice.vertices = vertices;
+    lattice.joints = joints;
+    lattice.meshToBody = meshToBody;
+    if (SoftBodyPool::instance().release(lattice)) {
+      joints.clear();
+      vertices.clear();
+      return;
+    }
+  }
+  
   // Remove joints.
-  ofRemove(joints, [&](std::shared_ptr<ofxBox2dJoint> j){
-    box2d.getWorld()->DestroyJoint(j->joint);
-    return true;
-  });
+  destroyJoints();
   
   // Remove vertices
   ofRemove(vertices, [&](std::shared_ptr<ofxBox2dCircle> c){
@@ -171,6 +291,14 @@ void Agent::clean(ofxBox2d &box2d) {
   vertices.clear();
 }
 
+void Agent::destroyJoints() {
+  for (auto &j : joints) {
+    world->DestroyJoint(j->joint);
+    JointPool::instance().release(j);
+  }
+  joints.clear();
+}
+
 void Agent::assignMessages(ofPoint meshSize) {
   // Create Bogus message circles.
   for (int i = 0; i < numBogusMessages; i++) {
@@ -182,19 +310,133 @@ void Agent::assignMessages(ofPoint meshSize) {
     int idx = ofRandom(1, palette.size());
     ofColor c = ofColor(palette.at(idx));
     
-    // Pick a random size (TOOD: Based off on the length of the message).
     int size = ofRandom(20, 40);
     
     // Create a message.
     Message m = Message(glm::vec2(x, y), c, size, "~");
-    messages.push_back(m);
+    messages.add(m);
   }
+  
+  // Real messages on top.
+  placeTextMessages(meshSize);
+}
+
+// The parsed messages are packed on the texture so they never cover each other.
+// Shorter messages get a bigger font.
+void Agent::placeTextMessages(ofPoint meshSize) {
+  // Random order, from the texture seed like the circles.
+  std::vector<int> order;
+  for (int i = 0; i < textMsgs.size(); i++) {
+    if (ofTrim(textMsgs[i]).size() > 0) {
+      order.push_back(i);
+    }
+  }
+  for (int i = order.size() - 1; i > 0; i--) {
+    std::swap(order[i], order[std::min((int) ofRandom(0, i + 1), i)]);
+  }
+  
+  SkylinePacker packer;
+  packer.setup(meshSize.x, meshSize.y);
+  numTextMessages = 0;
+  for (auto i : order) {
+    auto text = wrapText(ofTrim(textMsgs[i]), maxLineLength);
+    float scale = getTextScale(text);
+    auto box = font.getStringBoundingBox(text, 0, 0);
+    int w = ceil(box.width * scale) + textPadding;
+    int h = ceil(box.height * scale) + textPadding;
+    glm::vec2 pos;
+    if (!packer.insert(w, h, pos)) {
+      continue; // No room, the next one could be smaller.
+    }
+    
+    int idx = std::min((int) ofRandom(1, palette.size()), (int) palette.size() - 1);
+    Message m(pos, palette.at(idx), scale, text);
+    m.slot = ofRectangle(pos.x, pos.y, w, h);
+    fitText(messages.add(m));
+    numTextMessages++;
+  }
+}
+
+// Text that came in with a swap keeps to the slot, so texts still never cover each other.
+void Agent::fitText(MessageHandle h) {
+  auto &m = messages.get(h);
+  auto box = font.getStringBoundingBox(m.getText(), 0, 0);
+  float scale = getTextScale(m.getText());
+  if (box.width > 0 && box.height > 0) {
+    scale = std::min(scale, std::min((m.slot.width - textPadding) / box.width, (m.slot.height - textPadding) / box.height));
+  }
+  
+  // The box is relative to the baseline.
+  m.size = scale;
+  m.location = glm::vec2(m.slot.x, m.slot.y) + glm::vec2(-box.x, -box.y) * scale;
+}
+
+float Agent::getTextScale(const string &text) {
+  return ofClamp(maxTextScale * sqrt((float) shortTextLength / std::max((int) text.size(), 1)), minTextScale, maxTextScale);
+}
+
+string Agent::wrapText(string text, int maxChars) {
+  // Break at spaces, lines that are already there stay.
+  string wrapped;
+  auto paragraphs = ofSplitString(text, "\n");
+  for (int p = 0; p < paragraphs.size(); p++) {
+    int lineLength = 0;
+    for (auto &word : ofSplitString(paragraphs[p], " ", true)) {
+      if (lineLength > 0 && lineLength + 1 + word.size() > maxChars) {
+        wrapped += "\n";
+        lineLength = 0;
+      } else if (lineLength > 0) {
+        wrapped += " ";
+        lineLength++;
+      }
+      wrapped += word;
+      lineLength += word.size();
+    }
+    if (p + 1 < paragraphs.size()) {
+      wrapped += "\n";
+    }
+  }
+  
+  return wrapped;
 }
 
 void Agent::createTexture(ofPoint meshSize) {
-  // Create 1st fbo and draw all the messages. 
-  firstFbo.allocate(meshSize.x*2, meshSize.y*2, GL_RGBA);
-  firstFbo.begin();
+  // The texture is allocated once and reused for every regeneration (message swaps).
+  if (!textureFbo || textureFbo->getWidth() != (int) meshSize.x || textureFbo->getHeight() != (int) meshSize.y) {
+    if (textureFbo) {
+      FboPool::instance().release(textureFbo);
+    }
+    textureFbo = FboPool::instance().acquire(meshSize.x, meshSize.y);
+  }
+  
+  // Random layouts never repeat, no point caching them. Neither do the layouts after a swap.
+  bool useCache = textureSeed >= 0 && !messagesSwapped;
+  TextureKey key;
+  ofPixels pixels;
+  if (useCache) {
+    key = getTextureKey(meshSize);
+    if (TextureCache::instance().load(key, pixels)) {
+      textureFbo->getTexture().loadData(pixels);
+      return;
+    }
+  }
+  
+  // CPU fallback for weak GPUs.
+  if (cpuTexture) {
+    SoftRaster raster;
+    renderTexture(meshSize, raster);
+    pixels.swap(raster.getPixels());
+    textureFbo->getTexture().loadData(pixels);
+    if (useCache) {
+      TextureCache::instance().save(key, pixels);
+    }
+    return;
+  }
+  
+  // Draw all the messages into a scratch fbo. Only the mesh size part of it is
+  // used, so it's the same size as the texture and shared by agents of this size.
+  auto messagesFbo = FboPool::instance().acquire(meshSize.x, meshSize.y);
+  messagesFbo->begin();
     ofClear(0, 0, 0, 0);
   
     // Assign background.
@@ -206,37 +448,106 @@ void Agent::createTexture(ofPoint meshSize) {
       m.draw(font);
     }
 
-  firstFbo.end();
+  messagesFbo->end();
   
-  // Create 2nd fbo and draw with filter and postProcessing
-  secondFbo.allocate(meshSize.x, meshSize.y, GL_RGBA);
-  secondFbo.begin();
+  // Draw into the texture with filter and postProcessing
+  textureFbo->begin();
     ofClear(0, 0, 0, 0);
     filterChain->begin();
-      firstFbo.getTexture().drawSubsection(0, 0, meshSize.x, meshSize.y, 0, 0);
+      messagesFbo->draw(0, 0);
     filterChain->end();
-  secondFbo.end();
+  textureFbo->end();
+  
+  FboPool::instance().release(messagesFbo);
+  
+  if (useCache) {
+    textureFbo->readToPixels(pixels);
+    TextureCache::instance().save(key, pixels);
+  }
+}
+
+TextureKey Agent::getTextureKey(ofPoint meshSize) {
+  TextureKey key;
+  key.add("agent").add(2); // Bump the version when the texture pipeline changes.
+  key.add(glm::vec2(meshSize.x, meshSize.y)).add(textureSeed).add(cpuTexture ? 1 : 0);
+  for (auto c : palette) {
+    key.add(c);
+  }
+  
+  // The messages already depend on the seed, but they're what actually gets drawn.
+  for (auto &m : messages) {
+    key.add(m.location).add(m.color).add(m.size).add(m.getText());
+  }
+  
+  // Filter chain parameters.
+  key.add(softFilterChain ? softFilterChain->getDescription() : "");
+  return key;
+}
+
+void Agent::renderTexture(ofPoint meshSize, SoftRaster &raster) {
+  if (!softFont.isLoaded()) {
+    softFont.load("opensansbold.ttf", 25);
+  }
+  
+  // Mesh size, like the scratch fbo on the GPU path.
+  raster.allocate(meshSize.x, meshSize.y);
+  raster.clear(ofColor(palette.at(0), 250));
+  for (auto &m : messages) {
+    m.draw(raster, softFont);
+  }
+  raster.render();
+  
+  // Same as the texture fbo.
+  if (softFilterChain) {
+    softFilterChain->apply(raster.getPixels());
+  }
+}
+
+SoftFilterChain *Agent::getSoftFilterChain() {
+  return softFilterChain;
 }
 
 void Agent::applyBehaviors()  {
   // ----Current actions/behaviors---
-  handleStretch();
-  handleRepulsion();
-  handleAttraction();
-  handleTickle();
-  
+  // Each one is a coroutine (see Behavior.h), only the running ones are resumed.
+  double now = SimClock::instance().getTime();
+  behaviorDt = now - lastBehaviorTime;
+  lastBehaviorTime = now;
+  behaviors.update(now);
+}
+
+void Agent::startBehaviors() {
+  // Whatever the flags say should be running (after a restore).
+  if (applyStretch) {
+    behaviors.start(StretchBehavior, [this] { return stretch(); });
+  }
+  if (applyRepulsion) {
+    behaviors.start(RepulsionBehavior, [this] { return repel(); });
+  }
+  if (applyAttraction) {
+    behaviors.start(AttractionBehavior, [this] { return attract(); });
+  }
+  if (applyTickle) {
+    behaviors.start(TickleBehavior, [this] { return tickle(); });
+  }
+  wakeVertexBehaviors();
+}
+
+void Agent::wakeVertexBehaviors() {
   // Behavior of individual bodies on the agent (all circles mostly)
-  handleVertexBehaviors();
+  behaviors.start(VertexBehavior, [this] { return reactVertices(); });
 }
 
-void Agent::handleVertexBehaviors() {
-  for (auto &v : vertices) {
+Behavior Agent::reactVertices() {
+  // One tick for whatever was flagged since it was woken.
+  for (int i = 0; i < vertices.size(); i++) {
+    auto &v = vertices[i];
     auto data = reinterpret_cast<VertexData*>(v->getData());
     if (data->applyRepulsion) {
       // Repel this vertex from it's partner's centroid especially
       //auto pos = glm::vec2(partner->getCentroid().x, partner->getCentroid().y);
       auto pos = data->targetPos;
-      v->addRepulsionForce(pos.x, pos.y, vertexRepulsionWeight * 18);
+      addVertexRepulsion(i, pos, vertexRepulsionWeight * 18);
       
       // Reset repulsion parameter on the vertex.
       data->applyRepulsion = false;
@@ -247,40 +558,45 @@ void Agent::handleVertexBehaviors() {
       auto data = reinterpret_cast<VertexData*>(v->getData());
       auto pos = glm::vec2(data->targetPos.x, data->targetPos.y);
       //auto pos = data->targetPos;
-      v->addAttractionPoint({pos.x, pos.y}, attractionWeight * 20);
+      addVertexAttraction(i, pos, attractionWeight * 20);
       
       // Reset repulsion parameter on the vertex.
       data->applyAttraction = false;
       v->setData(data);
     }
   }
+  co_return;
 }
 
-void Agent::handleRepulsion() {
+Behavior Agent::repel() {
   // Go through all the vertices.
   // Get the data and check if it has.
-  if (applyRepulsion) {
-    repulsionWeight = ofLerp (repulsionWeight, vertexRepulsionWeight, 0.1);
-    for (auto &v : vertices) {
-      auto data = reinterpret_cast<VertexData*>(v->getData());
+  while (true) {
+    repulsionWeight = ofLerp (repulsionWeight, vertexRepulsionWeight, SimClock::getLerpAmount(0.1, behaviorDt));
+    auto partnerCentroid = partner->getCentroid(); // Once, not for every vertex.
+    for (int i = 0; i < vertices.size(); i++) {
+      auto data = reinterpret_cast<VertexData*>(vertices[i]->getData());
       if (data->hasInterAgentJoint) {
-         v->addRepulsionForce(partner->getCentroid().x, partner->getCentroid().y, repulsionWeight);
+         addVertexRepulsion(i, partnerCentroid, repulsionWeight);
       }
     }
     
     desireState = None;
     
     if (vertexRepulsionWeight-repulsionWeight < vertexRepulsionWeight/2) {
-      applyRepulsion = false;
-      repulsionWeight = 0;
+      break;
     }
+    co_await BehaviorScheduler::nextTick();
   }
+  
+  applyRepulsion = false;
+  repulsionWeight = 0;
 }
 
-void Agent::handleAttraction() {
+Behavior Agent::attract() {
   // Find the closest vertex from the boundary of indices and attract it to the
-  // centroid of the other mesh
-  if (applyAttraction) {
+  // centroid of the other mesh. Until the desire goes back to None.
+  while (applyAttraction) {
     float minD = 9999; int minIdx;
     // Find minimum distance idx.
     for (auto idx : boundaryIndices) {
@@ -300,42 +616,82 @@ void Agent::handleAttraction() {
     auto d = glm::distance(partner->getCentroid(), getCentroid()); // Distance till the centroid
     float newWeight = ofMap(d, desireRadius * 3, 0, attractionWeight, 0, true);
     auto pos = glm::vec2(partner->getCentroid().x, partner->getCentroid().y);
-    vertices[minIdx]->addAttractionPoint({pos.x, pos.y}, newWeight);
+    addVertexAttraction(minIdx, pos, newWeight);
+    co_await BehaviorScheduler::nextTick();
   }
 }
 
-void Agent::handleStretch() {
-  // Check for counter.
-  if (applyStretch) { // Time to apply a stretch.
-    stretchWeight = ofLerp(stretchWeight, maxStretchWeight, 0.1);
-    for (auto &v : vertices) {
+Behavior Agent::stretch() {
+  // Time to apply a stretch, it ramps up to the max weight.
+  while (true) {
+    stretchWeight = ofLerp(stretchWeight, maxStretchWeight, SimClock::getLerpAmount(0.1, behaviorDt));
+    auto centroid = mesh.getCentroid(); // Once, not for every vertex.
+    for (int i = lodStart; i < vertices.size(); i += lodStride) {
+      auto &v = vertices[i];
       auto data = reinterpret_cast<VertexData*>(v->getData());
       if (!data->hasInterAgentJoint) {
         if (ofRandom(1) < 0.2 ) {
-          v->addAttractionPoint({mesh.getCentroid().x, mesh.getCentroid().y}, stretchWeight);
+          addVertexAttraction(i, centroid, stretchWeight);
         } else {
-          v->addRepulsionForce(mesh.getCentroid().x, mesh.getCentroid().y, stretchWeight);
+          addVertexRepulsion(i, centroid, stretchWeight);
+        }
+        
+        // Rotation is invisible from far away.
+        if (lodLevel == Near) {
+          setVertexRotation(i, ofRandom(150));
         }
-        v->setRotation(ofRandom(150));
       }
     }
     
     if (maxStretchWeight - stretchWeight < 0.5) {
-      stretchWeight = 0;
-      applyStretch = false;
+      break;
     }
+    co_await BehaviorScheduler::nextTick();
   }
+  
+  stretchWeight = 0;
+  applyStretch = false;
 }
 
-void Agent::handleTickle() {
-  // Does the agent want to tickle? Check with counter conditions.
-  if (applyTickle == true) {
-    // Apply the tickle.
-    for (auto &v: vertices) {
-      glm::vec2 force = glm::vec2(ofRandom(-5, 5), ofRandom(-5, 5));
-      v -> addForce(force, tickleWeight);
-    }
-    applyTickle = false;
+Behavior Agent::tickle() {
+  // Apply the tickle.
+  for (int i = 0; i < vertices.size(); i++) {
+    glm::vec2 force = glm::vec2(ofRandom(-5, 5), ofRandom(-5, 5));
+    addVertexForce(i, force, tickleWeight);
+  }
+  applyTickle = false;
+  co_return;
+}
+
+void Agent::addVertexForce(int idx, glm::vec2 force, float scale) {
+  if (batchForces) {
+    forces.addForce(idx, force, scale);
+  } else {
+    vertices[idx]->addForce(force, scale);
+  }
+}
+
+void Agent::addVertexAttraction(int idx, glm::vec2 point, float amt) {
+  if (batchForces) {
+    forces.addAttractionPoint(idx, point, amt);
+  } else {
+    vertices[idx]->addAttractionPoint({point.x, point.y}, amt);
+  }
+}
+
+void Agent::addVertexRepulsion(int idx, glm::vec2 point, float amt) {
+  if (batchForces) {
+    forces.addRepulsionForce(idx, point, amt);
+  } else {
+    vertices[idx]->addRepulsionForce(point.x, point.y, amt);
+  }
+}
+
+void Agent::setVertexRotation(int idx, float degrees) {
+  if (batchForces) {
+    forces.setRotation(idx, degrees);
+  } else {
+    vertices[idx]->setRotation(degrees);
   }
 }
 
@@ -357,15 +713,160 @@ void Agent::repulseBondedVertices() {
       v->setData(data);
     }
   }
+  wakeVertexBehaviors();
 }
 
 void Agent::setTickle(float avgForceWeight) {
   applyTickle = true;
   tickleWeight = avgForceWeight;
+  behaviors.start(TickleBehavior, [this] { return tickle(); });
+  expandProxy();
 }
 
 void Agent::setStretch() {
   applyStretch = true;
+  behaviors.start(StretchBehavior, [this] { return stretch(); });
+  expandProxy();
+}
+
+int Agent::getNumBehaviors() {
+  return behaviors.getNumRunning();
+}
+
+void Agent::setParams(const Params &params) {
+  if (params.version == paramsVersion) {
+    return;
+  }
+  
+  paramsVersion = params.version;
+  setLodProperties(params.lod);
+  setBatchForces(params.batchForces);
+  setLimitInStep(params.limitInStep);
+}
+
+void Agent::setBatchForces(bool batch) {
+  batchForces = batch;
+}
+
+float Agent::getBehaviorTime() {
+  return behaviorTime;
+}
+
+void Agent::setLimitInStep(bool inStep) {
+  limitInStep = inStep;
+}
+
+void Agent::limitVelocities() {
+  // Runs on the shard's worker, only touches this agent's bodies.
+  if (!limitInStep || lodLevel == Proxy) {
+    return;
+  }
+  ForceAccumulator::limitVelocities(vertices, maxVelocity);
+}
+
+void Agent::setLodProperties(LodProperties props) {
+  lodProps = props;
+  lodProps.frameInterval = std::max(1, lodProps.frameInterval);
+  lodProps.vertexStride = std::max(1, lodProps.vertexStride);
+}
+
+LodLevel Agent::getLodLevel() {
+  return lodLevel;
+}
+
+void Agent::updateLod() {
+  // Something disturbed the proxy (contact with a memory, the grabber, etc).
+  if (lodLevel == Proxy) {
+    for (auto idx : boundaryIndices) {
+      if (vertices[idx]->body->IsAwake()) {
+        expandProxy();
+        break;
+      }
+    }
+  }
+  
+  if (!lodProps.enabled || partner == NULL || hasInterAgentJoints()) {
+    expandProxy();
+    return;
+  }
+  
+  // Is the partner within interaction range?
+  auto d = glm::distance(getCentroid(), partner->getCentroid());
+  bool isNear = d < (desireRadius + partner->desireRadius) * lodProps.range;
+  
+  if (isNear) {
+    expandProxy();
+  } else if (lodLevel == Near) {
+    lodLevel = Far;
+  } else if (lodLevel == Far && lodProps.useProxy && isIdle() && !isTouched()) {
+    // Has to stay quiet for a while first.
+    if (++lodIdleFrames >= lodProps.proxyDelay) {
+      collapseProxy();
+    }
+  } else if (lodLevel == Far) {
+    lodIdleFrames = 0;
+  }
+}
+
+bool Agent::isIdle() {
+  return !applyStretch && !applyTickle && !applyAttraction && !applyRepulsion && desireState == None;
+}
+
+// Something that moves (a memory, the other agent) is touching the boundary.
+bool Agent::isTouched() {
+  for (auto idx : boundaryIndices) {
+    for (auto ce = vertices[idx]->body->GetContactList(); ce; ce = ce->next) {
+      if (!ce->contact->IsTouching() || ce->other->GetType() == b2_staticBody) {
+        continue;
+      }
+      auto data = reinterpret_cast<VertexData*>(ce->other->GetUserData());
+      if (data == NULL || data->agent != this) {
+        return true;
+      }
+    }
+  }
+  
+  return false;
+}
+
+bool Agent::hasInterAgentJoints() {
+  for (auto &v : vertices) {
+    auto data = reinterpret_cast<VertexData*>(v->getData());
+    if (data->hasInterAgentJoint) {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+// Reduced proxy body. Disable the interior vertices (and with them the
+// interior joints) and put the boundary ring to sleep.
+void Agent::collapseProxy() {
+  for (auto &v : vertices) {
+    auto data = reinterpret_cast<VertexData*>(v->getData());
+    if (data->isBoundary) {
+      v->setVelocity(0, 0);
+      v->body->SetAwake(false);
+    } else {
+      v->body->SetActive(false);
+    }
+  }
+  
+  lodLevel = Proxy;
+}
+
+// Re-expand the full body.
+void Agent::expandProxy() {
+  if (lodLevel == Proxy) {
+    for (auto &v : vertices) {
+      v->body->SetActive(true);
+      v->body->SetAwake(true);
+    }
+  }
+  
+  lodLevel = Near;
+  lodIdleFrames = 0;
 }
 
 void Agent::createMesh(AgentProperties agentProps) {
@@ -376,113 +877,461 @@ void Agent::createMesh(AgentProperties agentProps) {
   int nRows = agentProps.meshDimensions.x;
   int nCols = agentProps.meshDimensions.y;
   
-  // Width, height for mapping the correct texture coordinate.
+  // Width, height of the mesh.
   int w = agentProps.meshSize.x;
   int h = agentProps.meshSize.y;
   
+  // Indices and texture coordinates are shared by every agent of this size. The
+  // agent's mesh only carries its own vertex positions.
+  gridMesh.setup(MeshTopology::get(nRows, nCols));
+  
   // Create the mesh.
   for (int y = 0; y < nRows; y++) {
     for (int x = 0; x < nCols; x++) {
-      float ix = agentProps.meshOrigin.x + w * x / (nCols - 1);
-      float iy = agentProps.meshOrigin.y + h * y / (nRows - 1);
-     
+      float ix = agentProps.meshOrigin.x + (float) w * x / (nCols - 1);
+      float iy = agentProps.meshOrigin.y + (float) h * y / (nRows - 1);
       mesh.addVertex({ix, iy, 0});
-      
-      // Height and Width of the texture is same as the width/height sent in via agentProps
-      float texX = ofMap(ix - agentProps.meshOrigin.x, 0, w, 0, 1, true); // Map the calculated x coordinate from 0 - 1
-      float texY = ofMap(iy - agentProps.meshOrigin.y, 0, h, 0, 1, true); // Map the calculated y coordinate from 0 - 1
-      mesh.addTexCoord({texX, texY});
-    }
-  }
-
-  // We don't draw the last row / col (nRows - 1 and nCols - 1) because it was
-  // taken care of by the row above and column to the left.
-  for (int y = 0; y < nRows - 1; y++)
-  {
-      for (int x = 0; x < nCols - 1; x++)
-      {
-          // Draw T0
-          // P0
-          mesh.addIndex((y + 0) * nCols + (x + 0));
-          // P1
-          mesh.addIndex((y + 0) * nCols + (x + 1));
-          // P2
-          mesh.addIndex((y + 1) * nCols + (x + 0));
-
-          // Draw T1
-          // P1
-          mesh.addIndex((y + 0) * nCols + (x + 1));
-          // P3
-          mesh.addIndex((y + 1) * nCols + (x + 1));
-          // P2
-          mesh.addIndex((y + 1) * nCols + (x + 0));
-      }
+    }
   }
 }
 
 void Agent::createSoftBody(ofxBox2d &box2d, AgentProperties agentProps) {
-  auto meshVertices = mesh.getVertices();
+  auto &meshVertices = mesh.getVertices();
   vertices.clear();
   joints.clear();
+  
+  // Keep these around, the lattice is refined later around inter agent joints.
+  world = box2d.getWorld();
+  softBodyProps = agentProps;
+  meshRows = agentProps.meshDimensions.x;
+  meshColumns = agentProps.meshDimensions.y;
+  interiorStep = std::max(1, agentProps.interiorStep);
+  
+  // Rest positions of the grid (used for joint lengths when the lattice is refined).
+  restPositions.clear();
+  for (auto &v : meshVertices) {
+    restPositions.push_back(glm::vec2(v.x, v.y));
+  }
+  
+  // Coarse cells of the interior lattice.
+  numCellsX = std::max(1, (meshColumns - 2 + interiorStep) / interiorStep);
+  numCellsY = std::max(1, (meshRows - 2 + interiorStep) / interiorStep);
+  refinedCells.assign(numCellsX * numCellsY, false);
+  
+  // Reuse a parked lattice if there is one.
+  softBodyKey.rows = meshRows; softBodyKey.cols = meshColumns; softBodyKey.interiorStep = interiorStep;
+  softBodyKey.width = agentProps.meshSize.x; softBodyKey.height = agentProps.meshSize.y;
+  softBodyKey.vertexRadius = agentProps.vertexRadius;
+  softBodyKey.vertexPhysics = agentProps.vertexPhysics;
+  softBodyKey.jointPhysics = agentProps.jointPhysics;
+  
+  SoftBodyLattice lattice;
+  if (SoftBodyPool::instance().acquire(softBodyKey, world, lattice)) {
+    reuseSoftBody(lattice);
+    return;
+  }
 
-  // Create mesh vertices as Box2D elements.
-  for (int i = 0; i < meshVertices.size(); i++) {
-    auto vertex = std::make_shared<ofxBox2dCircle>();
-    vertex -> setPhysics(agentProps.vertexPhysics.x, agentProps.vertexPhysics.y, agentProps.vertexPhysics.z); // bounce, density, friction
-    vertex -> setup(box2d.getWorld(), meshVertices[i].x, meshVertices[i].y, agentProps.vertexRadius); // ofRandom(3, agentProps.vertexRadius)
-    vertex -> setFixedRotation(true);
-    vertex -> setData(new VertexData(this)); // Data is passed with current Agent's pointer
-    vertices.push_back(vertex);
+  // Create mesh vertices as Box2D elements. With an interior step of 1 every
+  // vertex is simulated, else only the boundary and the coarse lattice are.
+  meshToBody.assign(meshVertices.size(), -1);
+  for (int y = 0; y < meshRows; y++) {
+    for (int x = 0; x < meshColumns; x++) {
+      if (isSimulated(x, y)) {
+        createVertex(x + y * meshColumns);
+      }
+    }
   }
   
-  int meshRows = agentProps.meshDimensions.x;
-  int meshColumns = agentProps.meshDimensions.y;
+  createJoints();
+  assignEmbeddedVertices();
+}
+
+// Reposition and re-enable a parked lattice.
+void Agent::reuseSoftBody(SoftBodyLattice &lattice) {
+  vertices = lattice.vertices;
+  joints = lattice.joints;
+  meshToBody = lattice.meshToBody;
   
-  // Create Box2d joints for the mesh.
+  for (auto &v : vertices) {
+    // Fresh vertex data for this agent.
+    auto data = reinterpret_cast<VertexData*>(v->getData());
+    int meshIdx = data->meshIdx;
+    *data = VertexData(this);
+    data->meshIdx = meshIdx;
+    
+    auto &pos = mesh.getVertices()[meshIdx];
+    v->body->SetActive(true);
+    v->setPosition(pos.x, pos.y);
+    v->setVelocity(0, 0);
+    v->body->SetAwake(true); // Pooled bodies may have gone to sleep, a zero velocity doesn't wake them.
+  }
+  
+  assignEmbeddedVertices();
+}
+
+void Agent::createVertex(int meshIdx) {
+  auto &pos = mesh.getVertices()[meshIdx];
+  auto vertex = std::make_shared<ofxBox2dCircle>();
+  vertex -> setPhysics(softBodyProps.vertexPhysics.x, softBodyProps.vertexPhysics.y, softBodyProps.vertexPhysics.z); // bounce, density, friction
+  vertex -> setup(world, pos.x, pos.y, softBodyProps.vertexRadius); // ofRandom(3, agentProps.vertexRadius)
+  vertex -> setFixedRotation(true);
+  auto data = new VertexData(this); // Data is passed with current Agent's pointer
+  data->meshIdx = meshIdx;
+  vertex -> setData(data);
+  
+  meshToBody[meshIdx] = vertices.size();
+  vertices.push_back(vertex);
+}
+
+void Agent::createJoints() {
+  for (auto &p : getJointPairs()) {
+    createJoint(p.first, p.second);
+  }
+}
+
+std::vector<std::pair<int, int>> Agent::getJointPairs() {
+  // Walk every row and every column and connect consecutive simulated vertices.
+  // Boundary and lattice lines always connect, other lines only connect neighbours
+  // inside a refined cell.
+  std::vector<std::pair<int, int>> pairs;
   for (int y = 0; y < meshRows; y++) {
+    int prev = -1;
     for (int x = 0; x < meshColumns; x++) {
-      int idx = x + y * meshColumns;
+      if (!isSimulated(x, y)) {
+        continue;
+      }
       
-      // Do this for all columns except last column.
-      // NOTE: Connect current vertex with the next vertex in the same row.
-      if (x != meshColumns - 1) {
-        auto joint = std::make_shared<ofxBox2dJoint>();
-        int rightIdx = idx + 1;
-        joint -> setup(box2d.getWorld(), vertices[idx] -> body, vertices[rightIdx] -> body, agentProps.jointPhysics.x, agentProps.jointPhysics.y); // frequency, damping
-        joints.push_back(joint);
+      if (prev >= 0) {
+        int cell = std::min(prev / interiorStep, numCellsX - 1) + std::min(y / interiorStep, numCellsY - 1) * numCellsX;
+        if (isLatticeRow(y) || (x == prev + 1 && refinedCells[cell])) {
+          pairs.push_back({ prev + y * meshColumns, x + y * meshColumns });
+        }
+      }
+      prev = x;
+    }
+  }
+  
+  for (int x = 0; x < meshColumns; x++) {
+    int prev = -1;
+    for (int y = 0; y < meshRows; y++) {
+      if (!isSimulated(x, y)) {
+        continue;
       }
       
-      // Do this for each row except the last row. There is no further joint to
-      // be made there.
-      if (y != meshRows - 1) {
-        auto joint = std::make_shared<ofxBox2dJoint>();
-        int downIdx = x + (y + 1) * meshColumns;
-        joint -> setup(box2d.getWorld(), vertices[idx] -> body, vertices[downIdx] -> body, agentProps.jointPhysics.x, agentProps.jointPhysics.y);
-        joints.push_back(joint);
+      if (prev >= 0) {
+        int cell = std::min(x / interiorStep, numCellsX - 1) + std::min(prev / interiorStep, numCellsY - 1) * numCellsX;
+        if (isLatticeColumn(x) || (y == prev + 1 && refinedCells[cell])) {
+          pairs.push_back({ x + prev * meshColumns, x + y * meshColumns });
+        }
       }
+      prev = y;
     }
   }
+  
+  return pairs;
+}
+
+void Agent::createJoint(int meshIdxA, int meshIdxB) {
+  auto joint = JointPool::instance().acquire();
+  auto bodyA = vertices[meshToBody[meshIdxA]] -> body;
+  auto bodyB = vertices[meshToBody[meshIdxB]] -> body;
+  joint -> setup(world, bodyA, bodyB, softBodyProps.jointPhysics.x, softBodyProps.jointPhysics.y); // frequency, damping
+  
+  // Rest length, in case the mesh is deformed when the lattice gets refined.
+  joint -> setLength(glm::distance(restPositions[meshIdxA], restPositions[meshIdxB]));
+  joints.push_back(joint);
+}
+
+// Vertices without a body follow the 4 corners of their coarse cell.
+void Agent::assignEmbeddedVertices() {
+  embeddedVertices.clear();
+  for (int y = 0; y < meshRows; y++) {
+    for (int x = 0; x < meshColumns; x++) {
+      if (isSimulated(x, y)) {
+        continue;
+      }
+      
+      int x0 = std::min(x / interiorStep, numCellsX - 1) * interiorStep; int x1 = std::min(x0 + interiorStep, meshColumns - 1);
+      int y0 = std::min(y / interiorStep, numCellsY - 1) * interiorStep; int y1 = std::min(y0 + interiorStep, meshRows - 1);
+      float tx = (float)(x - x0) / (x1 - x0);
+      float ty = (float)(y - y0) / (y1 - y0);
+      
+      EmbeddedVertex e;
+      e.meshIdx = x + y * meshColumns;
+      e.corners[0] = meshToBody[x0 + y0 * meshColumns]; e.weights[0] = (1 - tx) * (1 - ty);
+      e.corners[1] = meshToBody[x1 + y0 * meshColumns]; e.weights[1] = tx * (1 - ty);
+      e.corners[2] = meshToBody[x0 + y1 * meshColumns]; e.weights[2] = (1 - tx) * ty;
+      e.corners[3] = meshToBody[x1 + y1 * meshColumns]; e.weights[3] = tx * ty;
+      embeddedVertices.push_back(e);
+    }
+  }
+}
+
+// Switch to full resolution in the coarse cells around this vertex (it just got an inter agent joint).
+void Agent::refineAround(b2Body *body) {
+  auto data = reinterpret_cast<VertexData*>(body->GetUserData());
+  if (interiorStep == 1 || data == NULL || data->agent != this) {
+    return;
+  }
+  
+  int x = data->meshIdx % meshColumns; int y = data->meshIdx / meshColumns;
+  bool changed = false;
+  for (int cy = std::max(0, (y - 1) / interiorStep); cy <= std::min(y / interiorStep, numCellsY - 1); cy++) {
+    for (int cx = std::max(0, (x - 1) / interiorStep); cx <= std::min(x / interiorStep, numCellsX - 1); cx++) {
+      if (!refinedCells[cx + cy * numCellsX]) {
+        refinedCells[cx + cy * numCellsX] = true;
+        changed = true;
+      }
+    }
+  }
+  
+  if (changed) {
+    applyRefinement();
+  }
+}
+
+void Agent::applyRefinement() {
+  // New bodies where the embedded vertices currently are.
+  for (int y = 0; y < meshRows; y++) {
+    for (int x = 0; x < meshColumns; x++) {
+      int idx = x + y * meshColumns;
+      if (meshToBody[idx] < 0 && isSimulated(x, y)) {
+        createVertex(idx);
+      }
+    }
+  }
+  
+  // Rewire the lattice. Joints that are still wanted stay, only the lattice
+  // joints that now span a new vertex go. Everything else is added.
+  auto pairs = getJointPairs();
+  std::set<std::pair<int, int>> missing(pairs.begin(), pairs.end());
+  ofRemove(joints, [&](std::shared_ptr<ofxBox2dJoint> j) {
+    auto dataA = reinterpret_cast<VertexData*>(j->joint->GetBodyA()->GetUserData());
+    auto dataB = reinterpret_cast<VertexData*>(j->joint->GetBodyB()->GetUserData());
+    if (missing.erase({ dataA->meshIdx, dataB->meshIdx }) > 0) {
+      return false;
+    }
+    world->DestroyJoint(j->joint);
+    JointPool::instance().release(j);
+    return true;
+  });
+  for (auto &p : pairs) {
+    if (missing.count(p) > 0) {
+      createJoint(p.first, p.second);
+    }
+  }
+  assignEmbeddedVertices();
+}
+
+void Agent::moveToWorld(ofxBox2d &box2d) {
+  // Save the state of every body. VertexData is carried over as is.
+  struct BodyState {
+    glm::vec2 pos;
+    ofVec2f vel;
+    void *data;
+  };
+  std::vector<BodyState> states;
+  for (auto &v : vertices) {
+    states.push_back({ v->getPosition(), v->getVelocity(), v->getData() });
+  }
+  
+  // Remove from the old world.
+  destroyJoints();
+  for (auto &v : vertices) {
+    v->destroy();
+  }
+  vertices.clear();
+  
+  // Same bodies (same order, so meshToBody stays valid) in the new world.
+  world = box2d.getWorld();
+  for (auto &state : states) {
+    auto vertex = std::make_shared<ofxBox2dCircle>();
+    vertex -> setPhysics(softBodyProps.vertexPhysics.x, softBodyProps.vertexPhysics.y, softBodyProps.vertexPhysics.z); // bounce, density, friction
+    vertex -> setup(world, state.pos.x, state.pos.y, softBodyProps.vertexRadius);
+    vertex -> setFixedRotation(true);
+    vertex -> setVelocity(state.vel.x, state.vel.y);
+    vertex -> setData(state.data);
+    vertices.push_back(vertex);
+  }
+  createJoints();
+  
+  // Every body is awake and active in the new world.
+  lodLevel = Near;
+}
+
+void Agent::saveState(AgentState &state) {
+  state.messageFile = messageFile;
+  state.props = softBodyProps;
+  state.refinedCells = refinedCells;
+  
+  state.vertices.clear();
+  for (auto &v : vertices) {
+    auto data = reinterpret_cast<VertexData*>(v->body->GetUserData());
+    VertexState vs;
+    vs.meshIdx = data->meshIdx;
+    vs.body = Snapshot::getBodyState(v->body);
+    vs.applyRepulsion = data->applyRepulsion;
+    vs.applyAttraction = data->applyAttraction;
+    vs.hasInterAgentJoint = data->hasInterAgentJoint;
+    vs.targetPos = data->targetPos;
+    state.vertices.push_back(vs);
+  }
+  
+  // Messages only change on a swap, so most snapshots share the last copy.
+  if (messagesDirty || !savedMessages) {
+    savedMessages = std::make_shared<const MessageStore>(messages);
+    messagesDirty = false;
+  }
+  state.messages = savedMessages;
+  state.curMsg = curMsg;
+  
+  state.desireState = desireState;
+  state.seekTargetPos = seekTargetPos;
+  state.applyStretch = applyStretch;
+  state.applyTickle = applyTickle;
+  state.applyAttraction = applyAttraction;
+  state.applyRepulsion = applyRepulsion;
+  state.stretchWeight = stretchWeight;
+  state.repulsionWeight = repulsionWeight;
+  state.tickleWeight = tickleWeight;
+}
+
+// Agent has to be set up with the same properties first.
+void Agent::restoreState(const AgentState &state) {
+  // Same lattice as when it was saved.
+  expandProxy();
+  if (state.refinedCells.size() == refinedCells.size() && state.refinedCells != refinedCells) {
+    refinedCells = state.refinedCells;
+    applyRefinement();
+  }
+  
+  for (auto &vs : state.vertices) {
+    if (vs.meshIdx < 0 || vs.meshIdx >= meshToBody.size() || meshToBody[vs.meshIdx] < 0) {
+      continue;
+    }
+    auto body = getBody(vs.meshIdx);
+    Snapshot::setBodyState(body, vs.body);
+    auto data = reinterpret_cast<VertexData*>(body->GetUserData());
+    data->applyRepulsion = vs.applyRepulsion;
+    data->applyAttraction = vs.applyAttraction;
+    data->hasInterAgentJoint = vs.hasInterAgentJoint;
+    data->targetPos = vs.targetPos;
+  }
+  updateMesh();
+  
+  messages = *state.messages;
+  curMsg = messages.size() > 0 ? ofClamp(state.curMsg, 0, messages.size() - 1) : -1;
+  savedMessages = state.messages;
+  messagesDirty = false;
+  createTexture(softBodyProps.meshSize);
+  
+  desireState = (DesireState) state.desireState;
+  seekTargetPos = state.seekTargetPos;
+  applyStretch = state.applyStretch;
+  applyTickle = state.applyTickle;
+  applyAttraction = state.applyAttraction;
+  applyRepulsion = state.applyRepulsion;
+  stretchWeight = state.stretchWeight;
+  repulsionWeight = state.repulsionWeight;
+  tickleWeight = state.tickleWeight;
+  
+  // Coroutines can't be saved, they start over from the flags and weights.
+  behaviors.stopAll();
+  startBehaviors();
+}
+
+void Agent::markMessagesDirty() {
+  messagesDirty = true;
+  messagesSwapped = true;
+}
+
+string Agent::getMessageFile() {
+  return messageFile;
+}
+
+b2Body *Agent::getBody(int meshIdx) {
+  if (meshIdx < 0 || meshIdx >= meshToBody.size() || meshToBody[meshIdx] < 0) {
+    return NULL; // Not simulated.
+  }
+  return vertices[meshToBody[meshIdx]]->body;
+}
+
+bool Agent::isLatticeRow(int y) {
+  return y % interiorStep == 0 || y == meshRows - 1;
+}
+
+bool Agent::isLatticeColumn(int x) {
+  return x % interiorStep == 0 || x == meshColumns - 1;
+}
+
+bool Agent::isSimulated(int x, int y) {
+  // Boundary always has full resolution.
+  if (x == 0 || y == 0 || x == meshColumns - 1 || y == meshRows - 1) {
+    return true;
+  }
+  
+  // Interior lattice.
+  if (isLatticeRow(y) && isLatticeColumn(x)) {
+    return true;
+  }
+  
+  return isRefined(x, y);
+}
+
+// Is any of the cells this vertex belongs to refined? Vertices on lattice lines
+// are shared by the neighbouring cells.
+bool Agent::isRefined(int x, int y) {
+  for (int cy = std::max(0, (y - 1) / interiorStep); cy <= std::min(y / interiorStep, numCellsY - 1); cy++) {
+    for (int cx = std::max(0, (x - 1) / interiorStep); cx <= std::min(x / interiorStep, numCellsX - 1); cx++) {
+      if (refinedCells[cx + cy * numCellsX]) {
+        return true;
+      }
+    }
+  }
+  
+  return false;
 }
 
 void Agent::updateMesh() {
-  auto meshPoints = mesh.getVertices();
+  // Write straight into the mesh, no per-frame copy of the vertices.
+  auto &meshPoints = mesh.getVertices();
   
   for (int j = 0; j < meshPoints.size(); j++) {
+    if (meshToBody[j] < 0) {
+      continue;
+    }
+    
     // Get the box2D vertex position.
-    glm::vec2 pos = vertices[j] -> getPosition();
+    glm::vec2 pos = vertices[meshToBody[j]] -> getPosition();
     
     // Update mesh point's position with the position of
     // the box2d vertex.
-    auto meshPoint = meshPoints[j];
-    meshPoint.x = pos.x;
-    meshPoint.y = pos.y;
-    mesh.setVertex(j, meshPoint);
+    meshPoints[j].x = pos.x;
+    meshPoints[j].y = pos.y;
+  }
+  
+  // Interpolate the vertices that don't have a body.
+  for (auto &e : embeddedVertices) {
+    glm::vec2 pos = glm::vec2(0, 0);
+    for (int i = 0; i < 4; i++) {
+      pos += vertices[e.corners[i]] -> getPosition() * e.weights[i];
+    }
+    meshPoints[e.meshIdx].x = pos.x;
+    meshPoints[e.meshIdx].y = pos.y;
   }
 }
 
+DesireState Agent::getDesireState() {
+  return desireState;
+}
+
 void Agent::setDesireState(DesireState newState) {
   desireState = newState;
   
+  if (desireState != None) {
+    expandProxy();
+  }
+  
   
   if (desireState == None) {
     applyAttraction = false;
@@ -490,10 +1339,12 @@ void Agent::setDesireState(DesireState newState) {
   
   if (desireState == Attraction) {
     applyAttraction = true;
+    behaviors.start(AttractionBehavior, [this] { return attract(); });
   }
   
   if (desireState == Repulsion) {
     applyRepulsion = true;
+    behaviors.start(RepulsionBehavior, [this] { return repel(); });
   }
 }
 
@@ -3,7 +3,17 @@
 #include "ofxBox2d.h"
 #include "ofxFilterLibrary.h"
 #include "ofxPostProcessing.h"
-#include "Message.h"
+#include "MessageStore.h"
+#include "SkylinePacker.h"
+#include "SoftBodyPool.h"
+#include "JointPool.h"
+#include "MeshTopology.h"
+#include "TextureCache.h"
+#include "SoftFilters.h"
+#include "FboPool.h"
+#include "ForceAccumulator.h"
+#include "Behavior.h"
+#include "SimClock.h"
 
 struct AgentProperties {
   ofPoint meshSize; // w, h of the mesh.
@@ -13,14 +23,36 @@ struct AgentProperties {
   ofPoint textureDimensions; // Use it when we have a texture.
   ofPoint meshOrigin; // Derived class populates this. 
   float vertexRadius;
+  int interiorStep = 1; // Spacing of the interior lattice (1 is full resolution).
+  int textureSeed = -1; // Seed for the message layout. -1 is a new layout every time (not cached).
+  bool cpuTexture = false; // Render the texture with SoftRaster instead of FBOs.
 };
 
+struct AgentState;
+struct Params;
+
 enum DesireState {
   None,
   Attraction,
   Repulsion
 };
 
+// Level of detail for the soft body simulation.
+enum LodLevel {
+  Near, // Full update every frame.
+  Far, // Out of interaction range. Behaviors every N frames on a subset of vertices.
+  Proxy // Idle and far. Interior vertices are disabled, boundary is put to sleep.
+};
+
+struct LodProperties {
+  bool enabled = false;
+  float range = 3.f; // Interaction range (multiple of the desire radii).
+  int frameInterval = 4; // Update behaviors every N frames when far.
+  int vertexStride = 3; // Update every Nth vertex when far.
+  bool useProxy = true; // Collapse to a proxy body when far and idle.
+  int proxyDelay = 60; // Frames far and idle before collapsing, so a touch doesn't toggle it every few frames.
+};
+
 // Subsection body that is torn apart from the actual texture and falls on the ground. 
 class Agent {
   public:
@@ -33,33 +65,66 @@ class Agent {
   
     // Behaviors
     void applyBehaviors();
-    void handleRepulsion();
-    void handleAttraction();
-    void handleStretch();
-    void handleVertexBehaviors();
-    void handleTickle();
+    void startBehaviors();
+    int getNumBehaviors(); // Running
   
     // Enabling behaviors
     void setTickle(float weight);
     void setStretch();
     void repulseBondedVertices();
+    void wakeVertexBehaviors(); // After flagging vertices to repel or attract.
   
     // Helpers
     glm::vec2 getCentroid();
     ofMesh& getMesh();
     void setDesireState(DesireState state);
+    DesireState getDesireState();
     void enableAttraction(); 
   
+    void refineAround(b2Body *body);
+  
+    // Snapshot of everything that changes while it runs.
+    void saveState(AgentState &state);
+    void restoreState(const AgentState &state);
+    void markMessagesDirty(); // After changing messages from outside.
+    string getMessageFile();
+  
+    // Recreate the soft body in another world (shard migration).
+    void moveToWorld(ofxBox2d &box2d);
+    b2Body *getBody(int meshIdx);
+  
+    // Published GUI parameters, only copied when their version is newer than the last one.
+    void setParams(const Params &params);
+  
+    // Forces from all the behaviors applied in one go (else one wrapper call each).
+    void setBatchForces(bool batch);
+    float getBehaviorTime(); // ms, last update.
+  
+    // Velocity clamp in the shard's step (after every substep) instead of the update.
+    void setLimitInStep(bool inStep);
+    void limitVelocities(); // Called by the shard.
+  
+    // Level of detail
+    void setLodProperties(LodProperties props);
+    LodLevel getLodLevel();
+    void expandProxy();
+  
     // Vertices
     std::vector<std::shared_ptr<ofxBox2dCircle>> vertices; // Every vertex in the mesh is a circle.
   
     // Texture
     void createTexture(ofPoint meshSize);
+    void renderTexture(ofPoint meshSize, SoftRaster &raster); // Same texture without a GL context.
+    SoftFilterChain *getSoftFilterChain();
     ofPoint getTextureSize();
+    size_t getGpuBytes(); // Texture
+    size_t getCpuBytes(); // Messages, mesh, CPU filters
+    int getNumTextMessages(); // Placed when it was set up.
+    void fitText(MessageHandle h); // After a swap, scales the new text into the message's slot.
   
-    // Pubic iterator to access messages. 
-    std::vector<Message>::iterator curMsg;
-    std::vector<Message> messages;
+    // Public handle to the current message (the one that gets swapped).
+    MessageHandle curMsg;
+    MessageStore messages;
   
     // Agent's partner
     Agent *partner = NULL;
@@ -74,6 +139,7 @@ class Agent {
     std::vector<ofColor> palette;
     AbstractFilter *filter;
     FilterChain *filterChain;
+    SoftFilterChain *softFilterChain = NULL; // CPU copy of filterChain.
     ofxPostProcessing post;
   
     // Weights
@@ -89,16 +155,73 @@ class Agent {
   private:
     void readFile(string fileName);
     void assignMessages(ofPoint meshSize);
+    void placeTextMessages(ofPoint meshSize);
+    static string wrapText(string text, int maxChars);
+    float getTextScale(const string &text); // From the length.
+    TextureKey getTextureKey(ofPoint meshSize);
     void createMesh(AgentProperties softBodyProperties);
     void createSoftBody(ofxBox2d &box2d, AgentProperties softBodyProperties);
+    void reuseSoftBody(SoftBodyLattice &lattice);
+    void destroyJoints();
+    void createVertex(int meshIdx);
+    void createJoints();
+    std::vector<std::pair<int, int>> getJointPairs();
+    void createJoint(int meshIdxA, int meshIdxB);
+    void assignEmbeddedVertices();
+    bool isSimulated(int x, int y);
+    bool isRefined(int x, int y);
+    void applyRefinement();
+    bool isLatticeRow(int y);
+    bool isLatticeColumn(int x);
     void updateMesh();
     void assignIndices(AgentProperties agentProps);
+    void updateLod();
+    bool isIdle();
+    bool isTouched();
+    bool hasInterAgentJoints();
+    void collapseProxy();
+  
+    // Behaviors (coroutines, resumed by the scheduler while they run).
+    enum BehaviorId { StretchBehavior, RepulsionBehavior, AttractionBehavior, TickleBehavior, VertexBehavior };
+    Behavior stretch();
+    Behavior repel();
+    Behavior attract();
+    Behavior tickle();
+    Behavior reactVertices();
+    BehaviorScheduler behaviors;
+    double lastBehaviorTime = 0; // Sim time of the last behavior tick.
+    float behaviorDt = 0; // Since the one before (longer for far agents).
+  
+    // Vertex forces, through the accumulator or the wrapper.
+    void addVertexForce(int idx, glm::vec2 force, float scale);
+    void addVertexAttraction(int idx, glm::vec2 point, float amt);
+    void addVertexRepulsion(int idx, glm::vec2 point, float amt);
+    void setVertexRotation(int idx, float degrees);
   
     // ----------------- Data members -------------------
     std::vector<std::shared_ptr<ofxBox2dJoint>> joints; // Joints connecting those vertices.
   
-    // Mesh.
+    // Mesh. Only the positions, drawn with the shared topology.
     ofMesh mesh;
+    GridMesh gridMesh;
+  
+    // Adaptive soft body. Boundary is full resolution, the interior is a coarse
+    // lattice (refined around inter agent joints). Vertices without a body are
+    // interpolated from the corners of their cell.
+    struct EmbeddedVertex {
+      int meshIdx;
+      int corners[4];
+      float weights[4];
+    };
+    b2World *world;
+    AgentProperties softBodyProps;
+    SoftBodyKey softBodyKey;
+    int meshRows, meshColumns, interiorStep;
+    int numCellsX, numCellsY;
+    std::vector<int> meshToBody; // -1 if the mesh vertex doesn't have a body.
+    std::vector<bool> refinedCells;
+    std::vector<EmbeddedVertex> embeddedVertices;
+    std::vector<glm::vec2> restPositions;
   
     // Seek
     glm::vec2 seekTargetPos;
@@ -115,18 +238,51 @@ class Agent {
     // Repulsion
     bool applyRepulsion;
   
-    // Texture
-    ofFbo firstFbo;
-    ofFbo secondFbo;
+    // Level of detail.
+    LodProperties lodProps;
+    LodLevel lodLevel;
+    unsigned long lodFrame;
+    int lodIdleFrames; // Far and idle in a row.
+    unsigned long paramsVersion = 0; // Last Params applied.
+    int lodStart; // First vertex and stride for the behaviors this frame.
+    int lodStride;
+  
+    // Forces
+    ForceAccumulator forces;
+    bool batchForces = true;
+    bool limitInStep = false;
+    float behaviorTime = 0;
+  
+    // Texture (from the FboPool)
+    std::shared_ptr<ofFbo> textureFbo;
+    int textureSeed;
+    bool cpuTexture;
   
     // Messages for this agent.
     std::vector<string> textMsgs;
+    int numTextMessages = 0; // Placed on the texture.
+  
+    // Text layout. Messages of shortTextLength or less get the biggest scale of the font.
+    static const int maxLineLength = 24; // Characters
+    static const int shortTextLength = 12;
+    static constexpr float minTextScale = 0.15;
+    static constexpr float maxTextScale = 0.4;
+    static const int textPadding = 2; // px
+    string messageFile;
+  
+    // Messages as of the last snapshot, copied again only when they change.
+    std::shared_ptr<const MessageStore> savedMessages;
+    bool messagesDirty = true;
+    bool messagesSwapped = false; // Not the seeded layout anymore, so the texture isn't cached.
   
     // Figment's corner indices
     int cornerIndices[4];
     vector<int> boundaryIndices;
   
     ofTrueTypeFont font;
+  
+    // CPU rasterizer font, loaded on first renderTexture.
+    SoftFont softFont;
 };
 
 // Data Structure to hold a pointer to the agent instance
@@ -138,11 +294,15 @@ class VertexData {
       applyRepulsion = false;
       applyAttraction = false;
       hasInterAgentJoint = false; 
+      isBoundary = false;
+      meshIdx = -1;
     }
   
     Agent * agent;
     bool applyRepulsion;
     bool hasInterAgentJoint;
+    bool isBoundary;
+    int meshIdx; // Index of the vertex in the agent's mesh.
     bool applyAttraction;
     glm::vec2 targetPos; 
 };
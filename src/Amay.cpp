@@ -33,6 +33,11 @@ Amay::Amay(ofxBox2d &box2d, AgentProperties agentProps) {
   filterChain->addFilter(new LookupFilter(agentProps.meshSize.x, agentProps.meshSize.y, "img/lookup_amatorka.png"));
   filterChain->addFilter(new PoissonBlendFilter("img/grid.jpg", agentProps.meshSize.x, agentProps.meshSize.y, 0.6, 2));
   
+  softFilterChain = new SoftFilterChain();
+  softFilterChain->addFilter(new SoftPixellation(15));
+  softFilterChain->addFilter(new SoftLookup("img/lookup_amatorka.png"));
+  softFilterChain->addFilter(new SoftPoissonBlend("img/grid.jpg", 0.6, 2));
+  
   
   setup(box2d, agentProps, "amay.txt"); // TODO: Actually pass a pointer to all the messages later (for now it's assigned randomly)
 }
@@ -28,6 +28,11 @@ Azra::Azra(ofxBox2d &box2d, AgentProperties agentProps) {
   filterChain->addFilter(new PerlinPixellationFilter(agentProps.meshSize.x, agentProps.meshSize.y, 15.f));
   filterChain->addFilter(new LookupFilter(agentProps.meshSize.x, agentProps.meshSize.y, "img/lookup_miss_etikate.png"));
   filterChain->addFilter(new PoissonBlendFilter("img/tex.jpg", agentProps.meshSize.x, agentProps.meshSize.y, 0.6, 2));
+  
+  softFilterChain = new SoftFilterChain();
+  softFilterChain->addFilter(new SoftPixellation(15));
+  softFilterChain->addFilter(new SoftLookup("img/lookup_miss_etikate.png"));
+  softFilterChain->addFilter(new SoftPoissonBlend("img/tex.jpg", 0.6, 2));
   //filterChain->addFilter(new PerlinNoiseFilter(2.0));
   
   setup(box2d, agentProps, "azra.txt");
@@ -0,0 +1,61 @@
+#include "Behavior.h"
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+double BehaviorScheduler::curTime = 0;
+
+bool BehaviorScheduler::isRunning(int id) {
+  for (auto &t : tasks) {
+    if (t.id == id) {
+      return true;
+    }
+  }
+  for (auto &t : started) {
+    if (t.id == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void BehaviorScheduler::stopAll() {
+  tasks.clear();
+  started.clear();
+}
+
+void BehaviorScheduler::add(Task task) {
+  // Behaviors can start others while they run, those wait for the next tick.
+  if (isUpdating) {
+    started.push_back(std::move(task));
+    return;
+  }
+  
+  auto it = std::find_if(tasks.begin(), tasks.end(), [&](Task &t) { return t.id > task.id; });
+  tasks.insert(it, std::move(task));
+}
+
+void BehaviorScheduler::update(double time) {
+  if (tasks.empty()) {
+    return;
+  }
+  
+  curTime = time;
+  isUpdating = true;
+  for (auto &t : tasks) {
+    auto handle = t.behavior.handle;
+    if (handle.promise().wakeTime <= time) {
+      handle.resume();
+    }
+  }
+  isUpdating = false;
+  
+  ofRemove(tasks, [](Task &t) { return t.behavior.handle.done(); });
+  for (auto &t : started) {
+    add(std::move(t));
+  }
+  started.clear();
+}
+
+int BehaviorScheduler::getNumRunning() {
+  return tasks.size();
+}
@@ -0,0 +1,88 @@
+// Desires as C++20 coroutines. A behavior runs until it co_awaits the next tick or a delay,
+// then its agent's scheduler resumes it right there. Nothing is polled, so an agent with no
+// running behaviors costs nothing, and a new behavior is just another coroutine.
+//
+//   Behavior Agent::wiggle() {
+//     for (int i = 0; i < 10; i++) {
+//       ... forces ...
+//       co_await BehaviorScheduler::nextTick();
+//     }
+//     co_await BehaviorScheduler::sleep(2.f);
+//     ...
+//   }
+
+#pragma once
+#include "ofMain.h"
+#include <coroutine>
+
+class Behavior {
+  public:
+    struct promise_type {
+      double wakeTime = 0; // Seconds (sim time), resumed on the first tick after it.
+  
+      Behavior get_return_object() { return Behavior(std::coroutine_handle<promise_type>::from_promise(*this)); }
+      std::suspend_always initial_suspend() noexcept { return {}; } // Starts on the next tick.
+      std::suspend_always final_suspend() noexcept { return {}; } // Destroyed by the scheduler.
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+  
+    Behavior(Behavior &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    Behavior &operator=(Behavior &&other) noexcept {
+      std::swap(handle, other.handle);
+      return *this;
+    }
+    Behavior(const Behavior &) = delete;
+    Behavior &operator=(const Behavior &) = delete;
+    ~Behavior() {
+      if (handle) {
+        handle.destroy();
+      }
+    }
+  
+    Handle handle;
+  
+  private:
+    explicit Behavior(Handle h) : handle(h) {}
+};
+
+class BehaviorScheduler {
+  public:
+    // Only one behavior per id runs at a time, starting a running one does nothing
+    // (create isn't even called, so no coroutine frame is allocated).
+    template <typename F>
+    void start(int id, F create) {
+      if (!isRunning(id)) {
+        add({id, create()});
+      }
+    }
+    bool isRunning(int id);
+    void stopAll();
+  
+    // Resumes every behavior that's due, by id (so the order doesn't depend on when they started).
+    void update(double time);
+    int getNumRunning();
+  
+    // Awaitables.
+    struct Delay {
+      float seconds;
+      bool await_ready() { return false; }
+      void await_suspend(Behavior::Handle h) { h.promise().wakeTime = curTime + seconds; }
+      void await_resume() {}
+    };
+    static Delay nextTick() { return Delay{0}; }
+    static Delay sleep(float seconds) { return Delay{seconds}; }
+  
+  private:
+    struct Task {
+      int id;
+      Behavior behavior;
+    };
+    void add(Task task);
+    std::vector<Task> tasks; // Sorted by id.
+    std::vector<Task> started; // While updating, added after it.
+    bool isUpdating = false;
+  
+    static double curTime; // Of the update that's resuming.
+};
@@ -1,13 +1,43 @@
 #include "BgMesh.h"
 
-void BgMesh::setParams(ofParameterGroup params) {
-    bgParams = params;
+void BgMesh::setParams(const BgProperties &props) {
+  bool isNewLook = props.rectWidth != bgProps.rectWidth || props.rectHeight != bgProps.rectHeight
+    || props.cpuTexture != bgProps.cpuTexture;
+  bgProps = props;
+  
+  // Forces are checked by the field on its next update.
+  if (isNewLook && testImage.isAllocated()) {
+    createBg();
+  }
 }
 
 // Setup background
 void BgMesh::createBg() {
-  auto rectWidth = bgParams.getInt("Width");
-  auto rectHeight = bgParams.getInt("Height");
+  auto rectWidth = bgProps.rectWidth;
+  auto rectHeight = bgProps.rectHeight;
+  
+  // Background only depends on the screen and the rectangles.
+  bool cpuTexture = bgProps.cpuTexture;
+  TextureKey key;
+  key.add("bg").add(1).add(ofGetWidth()).add(ofGetHeight()).add(rectWidth).add(rectHeight).add(pixelSize).add(cpuTexture ? 1 : 0);
+  ofPixels pixels;
+  bool isCached = TextureCache::instance().load(key, pixels);
+  
+  // CPU fallback for weak GPUs (no post processing).
+  if (!isCached && cpuTexture) {
+    SoftRaster raster;
+    renderBg(raster, ofGetWidth(), ofGetHeight());
+    pixels.swap(raster.getPixels());
+    TextureCache::instance().save(key, pixels);
+    isCached = true;
+  }
+  
+  if (isCached) {
+    testImage.allocate(ofGetWidth(), ofGetHeight(), GL_RGBA);
+    testImage.getTexture().loadData(pixels);
+    createMesh();
+    return;
+  }
   
   bgImage.allocate(ofGetWidth()*2, ofGetHeight()*2, GL_RGBA);
   bgImage.begin();
@@ -45,6 +75,9 @@ void BgMesh::createBg() {
     post.end();
   testImage.end();
   
+  testImage.readToPixels(pixels);
+  TextureCache::instance().save(key, pixels);
+  
   //testImage.getTexture().enableMipmap();
   //testImage.getTexture().setTextureMinMagFilter(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_LINEAR);
   
@@ -52,48 +85,146 @@ void BgMesh::createBg() {
   createMesh();
 }
 
+void BgMesh::renderBg(SoftRaster &raster, int width, int height) {
+  auto rectWidth = bgProps.rectWidth;
+  auto rectHeight = bgProps.rectHeight;
+  
+  // Draw at twice the size like bgImage so the pattern lines up.
+  raster.allocate(width*2, height*2);
+  raster.clear(ofColor(0, 0, 0, 0));
+  raster.drawCheckerboard(rectWidth, rectHeight, ofColor::fromHex(0xDBDBDB), ofColor::fromHex(0x525151));
+  raster.render();
+  
+  raster.crop(width, height);
+  softPixellation.apply(raster.getPixels());
+}
+
 // Receive agent mesh
-void BgMesh::updateWithVertices(std::vector<ofMesh> agentMeshes) {
-  // Empty vector as size of background mesh's vertices.
-  std::vector<glm::vec2> offsets;
-  offsets.assign(mesh.getVertices().size(), glm::vec2(0, 0));
+void BgMesh::updateWithVertices(const FrameVector<ofMesh *> &agentMeshes) {
+  // One influence point per agent mesh.
+  FrameVector<glm::vec2> points;
   for (auto m : agentMeshes) {
-    auto vertices = m.getVertices();
-    std::vector<glm::vec2> randVertices;
-   randVertices.push_back(vertices[vertices.size()/2 -1]);
-    for (auto v : randVertices) {
-      for (int i = 0; i < mesh.getVertices().size(); i++) {
-        auto meshVertex = meshCopy.getVertices()[i];
-        offsets[i] = offsets.at(i) + interact(meshVertex, v, i);
-      }
-    }
+    auto &vertices = m->getVertices();
+    points.push_back(vertices[vertices.size()/2 -1]);
   }
   
-  // Update each mesh vertex with a displacement.
-  for (int i = 0; i < mesh.getVertices().size(); i++) {
-    auto newVertex = meshCopy.getVertices()[i] + offsets.at(i);
-    mesh.setVertex(i, {newVertex.x, newVertex.y, 0});
-  }
+  updateField(points);
 }
 
 void BgMesh::update(std::vector<glm::vec2> centroids) {
-  // Calculate net displacement due to each centroid and store in offsets.
-  std::vector<glm::vec2> offsets;
-  offsets.assign(mesh.getVertices().size(), glm::vec2(0, 0));
-  for (auto &c : centroids) {
-    for (int i = 0; i < mesh.getVertices().size(); i++) {
-      auto meshVertex = meshCopy.getVertices()[i];
-      offsets[i] = offsets.at(i) + interact(meshVertex, c, i);
-    }
+  FrameVector<glm::vec2> points(centroids.begin(), centroids.end());
+  updateField(points);
+}
+
+// Every point's contribution to every vertex is cached, along with where the point was
+// when it was computed (per tile). A tile is only recomputed for a point when the point
+// moved enough to change its contribution on that tile by more than epsilon.
+void BgMesh::updateField(const FrameVector<glm::vec2> &points) {
+  attraction = bgProps.attraction;
+  repulsion = bgProps.repulsion;
+  float epsilon = bgProps.epsilon;
+  
+  int numVertices = mesh.getVertices().size();
+  int numTiles = tiles.size();
+  bool reset = !isFieldValid || points.size() != numPoints || attraction != fieldAttraction || repulsion != fieldRepulsion;
+  if (reset) {
+    numPoints = points.size();
+    fieldAttraction = attraction;
+    fieldRepulsion = repulsion;
+    contributions.assign(numPoints * numVertices, glm::vec2(0, 0));
+    tilePoints.assign(numPoints * numTiles, glm::vec2(0, 0));
+    isFieldValid = true;
   }
   
-  // Update each mesh vertex with a displacement.
-  for (int i = 0; i < mesh.getVertices().size(); i++) {
-    auto newVertex = meshCopy.getVertices()[i] + offsets.at(i);
-    mesh.setVertex(i, {newVertex.x, newVertex.y, 0});
+  // How fast a contribution can change as its point moves: the displacement ramps over
+  // 800px, and the direction turns by at most (moved distance / distance to the tile).
+  float slope = abs(attraction + repulsion) / 800.f;
+  float maxDisplacement = std::max(abs(attraction), abs(repulsion));
+  
+  auto &restVertices = meshCopy.getVertices();
+  auto &vertices = mesh.getVertices();
+  numDirtyTiles = 0;
+  for (int t = 0; t < numTiles; t++) {
+    auto &tile = tiles[t];
+    bool isDirty = reset;
+    for (int k = 0; k < numPoints; k++) {
+      auto &tilePoint = tilePoints[k * numTiles + t];
+      if (!reset) {
+        float moved = glm::distance(points[k], tilePoint);
+        if (moved == 0) {
+          continue;
+        }
+        float d = std::max(distanceToTile(tile, tilePoint) - moved, 1.f);
+        if (moved * (slope + 2 * maxDisplacement / d) <= epsilon) {
+          continue;
+        }
+      }
+      
+      // Recompute this point on this tile.
+      for (int y = tile.row; y < tile.row + tile.numRows; y++) {
+        for (int x = tile.col; x < tile.col + tile.numCols; x++) {
+          int i = y * meshColumns + x;
+          contributions[k * numVertices + i] = interact(restVertices[i], points[k], i);
+        }
+      }
+      tilePoint = points[k];
+      isDirty = true;
+    }
+    
+    if (!isDirty) {
+      continue;
+    }
+    
+    // Sum the contributions again (no drift from incremental updates).
+    numDirtyTiles++;
+    for (int y = tile.row; y < tile.row + tile.numRows; y++) {
+      for (int x = tile.col; x < tile.col + tile.numCols; x++) {
+        int i = y * meshColumns + x;
+        glm::vec2 offset(0, 0);
+        for (int k = 0; k < numPoints; k++) {
+          offset += contributions[k * numVertices + i];
+        }
+        vertices[i] = restVertices[i] + glm::vec3(offset.x, offset.y, 0);
+      }
+    }
+  }
+}
+
+float BgMesh::distanceToTile(const FieldTile &tile, glm::vec2 p) {
+  float dx = std::max(std::max(tile.bounds.x - p.x, 0.f), p.x - tile.bounds.getRight());
+  float dy = std::max(std::max(tile.bounds.y - p.y, 0.f), p.y - tile.bounds.getBottom());
+  return sqrt(dx * dx + dy * dy);
+}
+
+void BgMesh::createTiles(int numRows, int numCols) {
+  tiles.clear();
+  meshColumns = numCols;
+  auto &restVertices = meshCopy.getVertices();
+  for (int row = 0; row < numRows; row += tileSize) {
+    for (int col = 0; col < numCols; col += tileSize) {
+      FieldTile tile;
+      tile.row = row;
+      tile.col = col;
+      tile.numRows = std::min(tileSize, numRows - row);
+      tile.numCols = std::min(tileSize, numCols - col);
+      
+      // Rest positions covered by the tile.
+      auto first = restVertices[row * numCols + col];
+      auto last = restVertices[(row + tile.numRows - 1) * numCols + col + tile.numCols - 1];
+      tile.bounds = ofRectangle(first.x, first.y, last.x - first.x, last.y - first.y);
+      tiles.push_back(tile);
+    }
   }
   
-  // Set filter parameter
+  isFieldValid = false;
+}
+
+int BgMesh::getNumTiles() {
+  return tiles.size();
+}
+
+int BgMesh::getNumDirtyTiles() {
+  return numDirtyTiles;
 }
 
 glm::vec2 BgMesh::interact(glm::vec2 meshVertex, glm::vec2 centroid, int vIdx) {
@@ -104,19 +235,18 @@ glm::vec2 BgMesh::interact(glm::vec2 meshVertex, glm::vec2 centroid, int vIdx) {
   glm::vec2 normal = glm::normalize(distance);
 
   // Calculate length of distance vector.
-  int distanceToCentroid = glm::length(distance);
+  float distanceToCentroid = glm::length(distance);
 
-  auto attraction = bgParams.getInt("Attraction");
-  auto repulsion = bgParams.getInt("Repulsion");
   // Closer the vertex is, more distortion. Farther the vertex, less is the distortion.
-  int displacement = ofMap(distanceToCentroid, 0, 800, attraction, -repulsion, true);
+  // Float (no whole pixel steps), so a contribution changes as smoothly as updateField assumes.
+  float displacement = ofMap(distanceToCentroid, 0, 800, attraction, -repulsion, true);
   
   return displacement * normal;
 }
 
 void BgMesh::draw() {
   testImage.getTexture().bind();
-  mesh.draw();
+  gridMesh.draw(mesh.getVertices());
   testImage.getTexture().unbind();
 }
 
@@ -127,8 +257,8 @@ void BgMesh::createMesh() {
   meshCopy.clear();
   mesh.setMode(OF_PRIMITIVE_TRIANGLES);
   
-  int rectWidth = bgParams.getInt("Width");
-  int rectHeight = bgParams.getInt("Height");
+  int rectWidth = bgProps.rectWidth;
+  int rectHeight = bgProps.rectHeight;
   
   // Rows/Columns
   int numRows = testImage.getHeight()/rectHeight;
@@ -138,44 +268,20 @@ void BgMesh::createMesh() {
   int w = testImage.getWidth();
   int h = testImage.getHeight();
   
-  // Mesh vertices and texture mapping.
+  // Indices and texture coordinates only depend on the grid.
+  gridMesh.setup(MeshTopology::get(numRows, numCols));
+  
+  // Mesh vertices.
   for (int y = 0; y < numRows; y++) {
     for (int x = 0; x < numCols; x++) {
-      float ix = w * x / (numCols - 1);
-      float iy = h * y / (numRows - 1);
+      float ix = (float) w * x / (numCols - 1);
+      float iy = (float) h * y / (numRows - 1);
       mesh.addVertex({ix, iy, 0});
-      
-      // Texture vertices (0 - 1) since textures are normalized.
-      float texX = ofMap(ix, 0, testImage.getTexture().getWidth(), 0, 1, true); // Map the calculated x coordinate from 0 - 1
-      float texY = ofMap(iy, 0, testImage.getTexture().getHeight(), 0, 1, true); // Map the calculated y coordinate from 0 - 1
-      mesh.addTexCoord(glm::vec2(texX, texY));
     }
   }
   
-  // We don't draw the last row / col (nRows - 1 and nCols - 1) because it was
-  // taken care of by the row above and column to the left.
-  for (int y = 0; y < numRows - 1; y++)
-  {
-      for (int x = 0; x < numCols - 1; x++)
-      {
-          // Draw T0
-          // P0
-          mesh.addIndex((y + 0) * numCols + (x + 0));
-          // P1
-          mesh.addIndex((y + 0) * numCols + (x + 1));
-          // P2
-          mesh.addIndex((y + 1) * numCols + (x + 0));
-
-          // Draw T1
-          // P1
-          mesh.addIndex((y + 0) * numCols + (x + 1));
-          // P3
-          mesh.addIndex((y + 1) * numCols + (x + 1));
-          // P2
-          mesh.addIndex((y + 1) * numCols + (x + 0));
-      }
-  }
-  
   // Deep mesh copy.
   meshCopy = mesh; 
+  
+  createTiles(numRows, numCols);
 }
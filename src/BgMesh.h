@@ -2,33 +2,73 @@
 #include "ofMain.h"
 #include "ofxFilterLibrary.h"
 #include "ofxPostProcessing.h"
+#include "FrameArena.h"
+#include "MeshTopology.h"
+#include "SoftFilters.h"
+#include "TextureCache.h"
+
+struct BgProperties {
+  int rectWidth = 20;
+  int rectHeight = 20;
+  int attraction = 20;
+  int repulsion = -20;
+  float epsilon = 0.5f; // Displacement change (px) below which vertices aren't updated.
+  bool cpuTexture = false; // Render without FBOs.
+};
 
 class BgMesh {
   public:
     BgMesh() {
-      filter = new PerlinPixellationFilter(ofGetWidth(), ofGetHeight(), 45.f);
+      filter = new PerlinPixellationFilter(ofGetWidth(), ofGetHeight(), pixelSize);
       post.init(ofGetWidth(), ofGetHeight());
       post.createPass<FxaaPass>()->setEnabled(true);
       //post.createPass<DofAltPass>()->setEnabled(true);
       post.createPass<DofPass>()->setEnabled(true);
     }
   
-    void setParams(ofParameterGroup params);
+    void setParams(const BgProperties &props); // Recreates the background if its look changed.
     void createBg();
+    void renderBg(SoftRaster &raster, int width, int height); // Same background without a GL context.
     void update(std::vector<glm::vec2> centroids);
-    void updateWithVertices(std::vector<ofMesh> meshes);
+    void updateWithVertices(const FrameVector<ofMesh *> &meshes);
     void draw();
   
+    int getNumTiles();
+    int getNumDirtyTiles(); // Recomputed last update.
+  
   private:
     void createMesh();
     glm::vec2 interact(glm::vec2 meshVertex, glm::vec2 centroid, int vIdx);
+  
+    // Incremental displacement field.
+    struct FieldTile {
+      int row, col, numRows, numCols; // Vertices
+      ofRectangle bounds; // Rest positions
+    };
+    void updateField(const FrameVector<glm::vec2> &points);
+    void createTiles(int numRows, int numCols);
+    float distanceToTile(const FieldTile &tile, glm::vec2 p);
+  
+    std::vector<FieldTile> tiles;
+    int tileSize = 8; // Vertices per side.
+    int meshColumns = 0;
+    std::vector<glm::vec2> contributions; // Point k's displacement of vertex i at [k * numVertices + i].
+    std::vector<glm::vec2> tilePoints; // Where point k was when tile t was computed, at [k * numTiles + t].
+    int numPoints = 0;
+    int numDirtyTiles = 0;
+    bool isFieldValid = false;
+    int attraction = 0, repulsion = 0; // This frame.
+    int fieldAttraction = 0, fieldRepulsion = 0; // What the contributions were computed with.
     
     ofFbo bgImage;
     ofFbo testImage; 
     ofMesh mesh;
     ofMesh meshCopy;
-    ofParameterGroup bgParams;
+    GridMesh gridMesh; // Shared indices and texture coordinates.
+    BgProperties bgProps;
   
     AbstractFilter * filter;
+    int pixelSize = 45; // Pixellation of the background.
+    SoftPixellation softPixellation = SoftPixellation(pixelSize); // CPU version of filter.
     ofxPostProcessing post; 
 };
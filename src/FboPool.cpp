@@ -0,0 +1,56 @@
+#include "FboPool.h"
+
+std::shared_ptr<ofFbo> FboPool::acquire(int width, int height) {
+  auto &fbos = freeFbos[std::make_pair(width, height)];
+  if (fbos.size() == 0) {
+    auto fbo = std::make_shared<ofFbo>();
+    fbo->allocate(width, height, GL_RGBA);
+    numCreated++;
+    numBytes += getBytes(width, height);
+    return fbo;
+  }
+  
+  auto fbo = fbos.back();
+  fbos.pop_back();
+  numFree--;
+  return fbo;
+}
+
+void FboPool::release(std::shared_ptr<ofFbo> fbo) {
+  int width = fbo->getWidth();
+  int height = fbo->getHeight();
+  auto &fbos = freeFbos[std::make_pair(width, height)];
+  if ((int) fbos.size() >= maxPerSize) {
+    // Let it go.
+    numBytes -= getBytes(width, height);
+    return;
+  }
+  
+  fbos.push_back(fbo);
+  numFree++;
+}
+
+int FboPool::getNumFree() {
+  return numFree;
+}
+
+int FboPool::getNumCreated() {
+  return numCreated;
+}
+
+size_t FboPool::getBytes() {
+  return numBytes;
+}
+
+size_t FboPool::getBytes(int width, int height) {
+  // GL_RGBA8, no depth or stencil.
+  return (size_t) width * height * 4;
+}
+
+FboPool &FboPool::instance() {
+  return p;
+}
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+FboPool FboPool::p;
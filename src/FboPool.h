@@ -0,0 +1,29 @@
+// Pool of RGBA fbos by size. Agents of the same mesh size share the scratch fbo they
+// draw their messages into, and a cleaned agent's texture goes to the next agent of
+// that size. Keeps count of the GPU memory held by all of them.
+// Singleton like Midi.
+
+#pragma once
+#include "ofMain.h"
+
+class FboPool {
+  public:
+    std::shared_ptr<ofFbo> acquire(int width, int height);
+    void release(std::shared_ptr<ofFbo> fbo);
+  
+    int getNumFree();
+    int getNumCreated();
+    size_t getBytes(); // GPU memory of every fbo that's alive (in use and free).
+  
+    static size_t getBytes(int width, int height);
+    static FboPool &instance();
+  
+  private:
+    std::map<std::pair<int, int>, std::vector<std::shared_ptr<ofFbo>>> freeFbos;
+    int maxPerSize = 4; // Two agents per spawn, plus the scratch fbos.
+    int numFree = 0;
+    int numCreated = 0;
+    size_t numBytes = 0;
+  
+    static FboPool p;
+};
@@ -0,0 +1,172 @@
+#include "ForceAccumulator.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Interleaved xy velocities. Clamped ones get flag set in flags.
+static void clampPacked(float *xy, int n, float maxVelocity, unsigned char *flags, unsigned char flag) {
+  if (n == 0) {
+    return;
+  }
+  
+  float maxSq = maxVelocity * maxVelocity;
+  int i = 0;
+#ifdef __SSE2__
+  // Two velocities per register, same math as the scalar loop (sqrt and div are exact in SSE).
+  const __m128 maxV = _mm_set1_ps(maxVelocity);
+  const __m128 maxSqV = _mm_set1_ps(maxSq);
+  for (; i + 2 <= n; i += 2) {
+    __m128 v = _mm_loadu_ps(xy + i * 2);
+    __m128 sq = _mm_mul_ps(v, v);
+    __m128 lengthSq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1))); // x² + y² in both lanes.
+    __m128 mask = _mm_cmpgt_ps(lengthSq, maxSqV);
+    int bits = _mm_movemask_ps(mask);
+    if (!bits) {
+      continue;
+    }
+    __m128 scaled = _mm_mul_ps(v, _mm_div_ps(maxV, _mm_sqrt_ps(lengthSq)));
+    _mm_storeu_ps(xy + i * 2, _mm_or_ps(_mm_and_ps(mask, scaled), _mm_andnot_ps(mask, v)));
+    if (bits & 1) flags[i] |= flag;
+    if (bits & 4) flags[i + 1] |= flag;
+  }
+#endif
+  
+  for (; i < n; i++) {
+    float x = xy[i * 2], y = xy[i * 2 + 1];
+    float lengthSq = x * x + y * y;
+    if (lengthSq > maxSq) {
+      float scale = maxVelocity / sqrtf(lengthSq);
+      xy[i * 2] = x * scale;
+      xy[i * 2 + 1] = y * scale;
+      flags[i] |= flag;
+    }
+  }
+}
+
+void ForceAccumulator::begin(const std::vector<std::shared_ptr<ofxBox2dCircle>> &vertices) {
+  int n = vertices.size();
+  bodies.resize(n);
+  positions.resize(n);
+  centers.resize(n);
+  velocities.resize(n);
+  forces.assign(n, glm::vec2(0, 0));
+  torques.assign(n, 0);
+  angles.resize(n);
+  flags.assign(n, 0);
+  
+  for (int i = 0; i < n; i++) {
+    auto body = vertices[i]->body;
+    bodies[i] = body;
+    auto &p = body->GetPosition();
+    auto c = body->GetWorldCenter();
+    auto v = body->GetLinearVelocity();
+    positions[i] = glm::vec2(p.x, p.y);
+    centers[i] = glm::vec2(c.x, c.y);
+    velocities[i] = glm::vec2(v.x, v.y);
+  }
+}
+
+void ForceAccumulator::apply() {
+  numApplied = 0;
+  for (int i = 0; i < bodies.size(); i++) {
+    if (!flags[i]) {
+      continue;
+    }
+  
+    auto body = bodies[i];
+    if (flags[i] & HasVelocity) {
+      body->SetLinearVelocity(b2Vec2(velocities[i].x, velocities[i].y));
+    }
+    if (flags[i] & HasRotation) {
+      body->SetTransform(body->GetPosition(), angles[i]);
+    }
+    if (flags[i] & HasForce) {
+      // Sum of every force at its own point = total at the center + the torque they add up to.
+      body->ApplyForce(b2Vec2(forces[i].x, forces[i].y), body->GetWorldCenter(), true);
+      body->ApplyTorque(torques[i], true);
+    }
+    numApplied++;
+  }
+  
+  std::fill(flags.begin(), flags.end(), 0);
+}
+
+void ForceAccumulator::addForce(int idx, glm::vec2 force, float scale) {
+  addForceAt(idx, force * scale, positions[idx]);
+}
+
+void ForceAccumulator::addAttractionPoint(int idx, glm::vec2 point, float amt) {
+  glm::vec2 p = point / OFX_BOX2D_SCALE;
+  glm::vec2 d = p - positions[idx];
+  float length = glm::length(p);
+  if (length >= FLT_EPSILON) {
+    p /= length;
+  }
+  addForceAt(idx, amt * d, p);
+}
+
+void ForceAccumulator::addRepulsionForce(int idx, glm::vec2 point, float amt) {
+  glm::vec2 p = point / OFX_BOX2D_SCALE;
+  glm::vec2 d = p - positions[idx];
+  float length = glm::length(p);
+  if (length >= FLT_EPSILON) {
+    p /= length;
+  }
+  addForceAt(idx, -amt * d, p);
+}
+
+void ForceAccumulator::setVelocity(int idx, glm::vec2 velocity) {
+  velocities[idx] = velocity;
+  flags[idx] |= HasVelocity;
+}
+
+void ForceAccumulator::setRotation(int idx, float degrees) {
+  angles[idx] = ofDegToRad(degrees);
+  flags[idx] |= HasRotation;
+}
+
+glm::vec2 ForceAccumulator::getVelocity(int idx) {
+  return velocities[idx];
+}
+
+void ForceAccumulator::clampVelocities(float maxVelocity) {
+  clampPacked(reinterpret_cast<float *>(velocities.data()), velocities.size(), maxVelocity, flags.data(), HasVelocity);
+}
+
+void ForceAccumulator::limitVelocities(const std::vector<std::shared_ptr<ofxBox2dCircle>> &vertices, float maxVelocity) {
+  // Every shard's worker has its own.
+  thread_local std::vector<glm::vec2> velocities;
+  thread_local std::vector<unsigned char> clamped;
+  
+  int n = vertices.size();
+  velocities.resize(n);
+  clamped.assign(n, 0);
+  for (int i = 0; i < n; i++) {
+    auto v = vertices[i]->body->GetLinearVelocity();
+    velocities[i] = glm::vec2(v.x, v.y);
+  }
+  
+  clampPacked(reinterpret_cast<float *>(velocities.data()), n, maxVelocity, clamped.data(), 1);
+  
+  for (int i = 0; i < n; i++) {
+    if (clamped[i]) {
+      vertices[i]->body->SetLinearVelocity(b2Vec2(velocities[i].x, velocities[i].y));
+    }
+  }
+}
+
+int ForceAccumulator::size() {
+  return bodies.size();
+}
+
+int ForceAccumulator::getNumApplied() {
+  return numApplied;
+}
+
+void ForceAccumulator::addForceAt(int idx, glm::vec2 force, glm::vec2 point) {
+  // Same as b2Body::ApplyForce.
+  glm::vec2 arm = point - centers[idx];
+  forces[idx] += force;
+  torques[idx] += arm.x * force.y - arm.y * force.x;
+  flags[idx] |= HasForce;
+}
@@ -0,0 +1,50 @@
+// Forces on a soft body's vertices, collected by the behaviors in Box2D units and applied to
+// the bodies in one loop at the end of the agent's update. Positions and velocities are read
+// once up front, so the behaviors only touch these arrays (never the bodies) and could run
+// off the main thread.
+//
+// The math is the same as the ofxBox2dBaseShape helpers, including the odd application point
+// of addAttractionPoint/addRepulsionForce (the normalized target), so the torque matches too.
+
+#pragma once
+#include "ofMain.h"
+#include "ofxBox2d.h"
+
+class ForceAccumulator {
+  public:
+    void begin(const std::vector<std::shared_ptr<ofxBox2dCircle>> &vertices);
+    void apply(); // Writes everything to the bodies and clears.
+  
+    // Same arguments as the wrapper.
+    void addForce(int idx, glm::vec2 force, float scale);
+    void addAttractionPoint(int idx, glm::vec2 point, float amt); // Point in screen units.
+    void addRepulsionForce(int idx, glm::vec2 point, float amt);
+    void setVelocity(int idx, glm::vec2 velocity);
+    void setRotation(int idx, float degrees);
+    glm::vec2 getVelocity(int idx); // As of begin (or the last setVelocity).
+  
+    // Scales every velocity longer than maxVelocity back to it (SIMD over the packed array).
+    void clampVelocities(float maxVelocity);
+  
+    // Same clamp straight on the bodies (read, clamp, write back the changed ones). For the
+    // shard's step, where there's no accumulator pass.
+    static void limitVelocities(const std::vector<std::shared_ptr<ofxBox2dCircle>> &vertices, float maxVelocity);
+  
+    int size();
+    int getNumApplied(); // Bodies written by the last apply.
+  
+  private:
+    void addForceAt(int idx, glm::vec2 force, glm::vec2 point);
+  
+    enum Flags : unsigned char { HasForce = 1, HasVelocity = 2, HasRotation = 4 };
+  
+    std::vector<b2Body *> bodies;
+    std::vector<glm::vec2> positions; // World
+    std::vector<glm::vec2> centers; // World center of mass (torque arm).
+    std::vector<glm::vec2> velocities;
+    std::vector<glm::vec2> forces;
+    std::vector<float> torques;
+    std::vector<float> angles; // Radians
+    std::vector<unsigned char> flags;
+    int numApplied = 0;
+};
@@ -0,0 +1,74 @@
+#include "FrameArena.h"
+
+FrameArena::FrameArena() {
+  // Initial size. Grows to the high water mark if a frame ever needs more.
+  block.resize(256 * 1024);
+  offset = 0;
+  overflowBytes = 0;
+  overflowCount = 0;
+  highWaterMark = 0;
+}
+
+void *FrameArena::allocate(std::size_t bytes, std::size_t alignment) {
+  // Align the bump pointer.
+  auto base = reinterpret_cast<std::uintptr_t>(block.data());
+  std::size_t aligned = (base + offset + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+  aligned -= base;
+  
+  if (aligned + bytes > block.size()) {
+    return allocateOverflow(bytes, alignment);
+  }
+  
+  offset = aligned + bytes;
+  highWaterMark = std::max(highWaterMark, offset + overflowBytes);
+  return block.data() + aligned;
+}
+
+void *FrameArena::allocateOverflow(std::size_t bytes, std::size_t alignment) {
+  // Doesn't fit in this frame's block. Hand out a separate chunk, which is
+  // released on reset.
+  std::unique_ptr<unsigned char[]> chunk(new unsigned char[bytes + alignment]);
+  auto p = reinterpret_cast<std::uintptr_t>(chunk.get());
+  p = (p + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+  overflow.push_back(std::move(chunk));
+  
+  overflowBytes += bytes + alignment;
+  overflowCount++;
+  highWaterMark = std::max(highWaterMark, offset + overflowBytes);
+  return reinterpret_cast<void*>(p);
+}
+
+void FrameArena::reset() {
+  // Last frame overflowed, so grow the block to fit what we actually needed.
+  if (overflow.size() > 0) {
+    overflow.clear();
+    block.resize(highWaterMark * 2);
+  }
+  
+  offset = 0;
+  overflowBytes = 0;
+}
+
+std::size_t FrameArena::getCapacity() {
+  return block.size();
+}
+
+std::size_t FrameArena::getUsed() {
+  return offset + overflowBytes;
+}
+
+std::size_t FrameArena::getHighWaterMark() {
+  return highWaterMark;
+}
+
+int FrameArena::getOverflowCount() {
+  return overflowCount;
+}
+
+FrameArena &FrameArena::instance() {
+  return a;
+}
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+FrameArena FrameArena::a;
@@ -0,0 +1,62 @@
+// Bump-pointer arena for short lived, per-frame data (offsets, mesh lists, command lists, etc).
+// Everything allocated from it is released in one go when ofApp::update calls reset()
+// at the top of the frame. Singleton like Midi, so any component can reach it.
+
+#pragma once
+#include "ofMain.h"
+
+class FrameArena {
+  public:
+    void *allocate(std::size_t bytes, std::size_t alignment);
+    void reset();
+  
+    // Sizing stats.
+    std::size_t getCapacity();
+    std::size_t getUsed();
+    std::size_t getHighWaterMark();
+    int getOverflowCount();
+  
+    static FrameArena &instance();
+  
+  private:
+    FrameArena();
+    void *allocateOverflow(std::size_t bytes, std::size_t alignment);
+  
+    std::vector<unsigned char> block;
+    std::size_t offset;
+  
+    // Requests that didn't fit in this frame. Released on reset
+    // and the main block grows so the next frame fits.
+    std::vector<std::unique_ptr<unsigned char[]>> overflow;
+    std::size_t overflowBytes;
+    int overflowCount;
+  
+    std::size_t highWaterMark;
+  
+    static FrameArena a;
+};
+
+// STL allocator on top of the frame arena. Deallocation is a no-op, memory
+// only comes back on FrameArena::reset(), so never keep these containers across frames.
+template <typename T>
+class FrameAllocator {
+  public:
+    typedef T value_type;
+  
+    FrameAllocator() {}
+    template <typename U> FrameAllocator(const FrameAllocator<U> &other) {}
+  
+    T *allocate(std::size_t n) {
+      return static_cast<T*>(FrameArena::instance().allocate(n * sizeof(T), alignof(T)));
+    }
+  
+    void deallocate(T *p, std::size_t n) {
+      // Freed en masse on reset.
+    }
+  
+    template <typename U> bool operator==(const FrameAllocator<U> &other) const { return true; }
+    template <typename U> bool operator!=(const FrameAllocator<U> &other) const { return false; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
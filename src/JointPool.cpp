@@ -0,0 +1,41 @@
+#include "JointPool.h"
+
+std::shared_ptr<ofxBox2dJoint> JointPool::acquire() {
+  if (freeJoints.size() == 0) {
+    numCreated++;
+    return std::make_shared<ofxBox2dJoint>();
+  }
+  
+  auto j = freeJoints.back();
+  freeJoints.pop_back();
+  return j;
+}
+
+void JointPool::release(std::shared_ptr<ofxBox2dJoint> joint) {
+  // Don't hold on to the destroyed Box2D joint.
+  joint->joint = NULL;
+  freeJoints.push_back(joint);
+}
+
+void JointPool::reserve(int numJoints) {
+  while (freeJoints.size() < numJoints) {
+    numCreated++;
+    freeJoints.push_back(std::make_shared<ofxBox2dJoint>());
+  }
+}
+
+int JointPool::getNumFree() {
+  return freeJoints.size();
+}
+
+int JointPool::getNumCreated() {
+  return numCreated;
+}
+
+JointPool &JointPool::instance() {
+  return p;
+}
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+JointPool JointPool::p;
@@ -0,0 +1,25 @@
+// Pool of ofxBox2dJoint wrappers. Box2D joints can't be reused, but the wrappers
+// can, so broken/evicted joints come back here instead of being freed.
+// Singleton like Midi, since joints are created and destroyed all over.
+
+#pragma once
+#include "ofMain.h"
+#include "ofxBox2d.h"
+
+class JointPool {
+  public:
+    std::shared_ptr<ofxBox2dJoint> acquire();
+    void release(std::shared_ptr<ofxBox2dJoint> joint); // Box2D joint has to be destroyed already.
+    void reserve(int numJoints);
+  
+    int getNumFree();
+    int getNumCreated();
+  
+    static JointPool &instance();
+  
+  private:
+    std::vector<std::shared_ptr<ofxBox2dJoint>> freeJoints;
+    int numCreated = 0;
+  
+    static JointPool p;
+};
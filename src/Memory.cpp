@@ -1,5 +1,6 @@
 #include "Memory.h"
 #include "Agent.h" 
+#include "SimClock.h"
 
 Memory::Memory(ofxBox2d &box2d, glm::vec2 location) {
   mem = std::make_shared<ofxBox2dCircle>();
@@ -9,18 +10,56 @@ Memory::Memory(ofxBox2d &box2d, glm::vec2 location) {
   mem -> setVelocity(ofRandom(-5, 5), ofRandom(-5, 5)); // Random velocity
   mem -> setData(new VertexData(NULL)); // No agent pointer for this.
   
-  curTime = ofGetElapsedTimeMillis();
+  curTime = SimClock::instance().getTimeMillis();
   maxTime = ofRandom(5000, 10000);
-  shouldRemove = false;
+  id = 0;
   finalColor = ofColor(0xDBDBDB);
   color = ofColor(0x525151);
 }
 
-void Memory::update() {
-  elapsedTime = ofGetElapsedTimeMillis() - curTime;
-  if (elapsedTime >= maxTime) {
-    shouldRemove = true; 
-  }
+Memory::Memory(ofxBox2d &box2d, glm::vec2 location, glm::vec2 velocity, float radius, unsigned long elapsed, unsigned long duration) {
+  mem = std::make_shared<ofxBox2dCircle>();
+  mem -> setPhysics(0.3, 0.3, 0.3); // bounce, density, friction
+  mem -> setup(box2d.getWorld(), location.x, location.y, radius);
+  mem -> setFixedRotation(true);
+  mem -> setVelocity(velocity.x, velocity.y);
+  mem -> setData(new VertexData(NULL)); // No agent pointer for this.
+  
+  // Continue where it was.
+  curTime = SimClock::instance().getTimeMillis() - elapsed;
+  maxTime = duration;
+  id = 0;
+  finalColor = ofColor(0xDBDBDB);
+  color = ofColor(0x525151);
+}
+
+b2World *Memory::getWorld() {
+  return mem->body->GetWorld();
+}
+
+glm::vec2 Memory::getPosition() {
+  return mem->getPosition();
+}
+
+glm::vec2 Memory::getVelocity() {
+  auto v = mem->getVelocity();
+  return glm::vec2(v.x, v.y);
+}
+
+float Memory::getRadius() {
+  return mem->getRadius();
+}
+
+unsigned long Memory::getElapsedTime() {
+  return SimClock::instance().getTimeMillis() - curTime;
+}
+
+unsigned long Memory::getMaxTime() {
+  return maxTime;
+}
+
+unsigned long Memory::getExpiry() {
+  return curTime + maxTime;
 }
 
 void Memory::draw() {
@@ -28,7 +67,7 @@ void Memory::draw() {
     ofTranslate(mem->getPosition());
     ofPushStyle();
       color = color.lerp(finalColor, 1.0);
-      auto opacity = ofMap(elapsedTime, 0, maxTime, 255, 50, true);
+      auto opacity = ofMap(getElapsedTime(), 0, maxTime, 255, 50, true);
       ofSetColor(color, opacity);
       ofDrawCircle(0, 0, mem->getRadius());
     ofPopStyle();
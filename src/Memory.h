@@ -6,15 +6,24 @@
 class Memory {
   public:
     Memory(ofxBox2d &box2d, glm::vec2 location);
-    void update();
+    Memory(ofxBox2d &box2d, glm::vec2 location, glm::vec2 velocity, float radius, unsigned long elapsed, unsigned long maxTime); // Snapshot
     void draw();
-    bool shouldRemove;
+    b2World *getWorld();
+  
+    // Snapshot
+    glm::vec2 getPosition();
+    glm::vec2 getVelocity();
+    float getRadius();
+    unsigned long getElapsedTime();
+    unsigned long getMaxTime();
+    unsigned long getExpiry(); // Sim time (ms) it should go.
+  
+    uint64_t id; // Set by ofApp, for its expiry timer.
     ofColor finalColor;
     ofColor color; 
   
   private:
     std::shared_ptr<ofxBox2dCircle> mem;
-    unsigned long curTime;
+    unsigned long curTime; // Sim time (ms) it was created.
     unsigned long maxTime;
-    unsigned long elapsedTime; 
 };
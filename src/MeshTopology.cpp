@@ -0,0 +1,198 @@
+#include "MeshTopology.h"
+
+std::shared_ptr<MeshTopology> MeshTopology::get(int rows, int cols) {
+  auto key = std::make_pair(rows, cols);
+  auto topology = cache[key].lock();
+  if (!topology) {
+    topology = std::shared_ptr<MeshTopology>(new MeshTopology(rows, cols));
+    cache[key] = topology;
+  }
+  
+  return topology;
+}
+
+MeshTopology::MeshTopology(int numRows, int numCols) {
+  rows = numRows;
+  cols = numCols;
+  isUploaded = false;
+  
+  // Texture coordinates follow the grid.
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < cols; x++) {
+      texCoords.push_back(glm::vec2((float) x / (cols - 1), (float) y / (rows - 1)));
+    }
+  }
+  
+  // We don't draw the last row / col (nRows - 1 and nCols - 1) because it was
+  // taken care of by the row above and column to the left.
+  for (int y = 0; y < rows - 1; y++)
+  {
+      for (int x = 0; x < cols - 1; x++)
+      {
+          // Draw T0
+          // P0
+          indices.push_back((y + 0) * cols + (x + 0));
+          // P1
+          indices.push_back((y + 0) * cols + (x + 1));
+          // P2
+          indices.push_back((y + 1) * cols + (x + 0));
+
+          // Draw T1
+          // P1
+          indices.push_back((y + 0) * cols + (x + 1));
+          // P3
+          indices.push_back((y + 1) * cols + (x + 1));
+          // P2
+          indices.push_back((y + 1) * cols + (x + 0));
+      }
+  }
+}
+
+int MeshTopology::getRows() {
+  return rows;
+}
+
+int MeshTopology::getCols() {
+  return cols;
+}
+
+const std::vector<ofIndexType> &MeshTopology::getIndices() {
+  return indices;
+}
+
+const std::vector<glm::vec2> &MeshTopology::getTexCoords() {
+  return texCoords;
+}
+
+ofBufferObject &MeshTopology::getIndexBuffer() {
+  if (!isUploaded) {
+    indexBuffer.allocate(indices, GL_STATIC_DRAW);
+    texCoordBuffer.allocate(texCoords, GL_STATIC_DRAW);
+    isUploaded = true;
+  }
+  
+  return indexBuffer;
+}
+
+ofBufferObject &MeshTopology::getTexCoordBuffer() {
+  getIndexBuffer(); // Makes sure both are uploaded.
+  return texCoordBuffer;
+}
+
+std::map<std::pair<int, int>, std::weak_ptr<MeshTopology>> MeshTopology::cache;
+
+GridMesh::~GridMesh() {
+  releaseFences();
+}
+
+void GridMesh::setup(std::shared_ptr<MeshTopology> meshTopology) {
+  topology = meshTopology;
+  isAllocated = false;
+}
+
+void GridMesh::allocate(size_t n) {
+  releaseFences();
+  numVertices = n;
+  mappedPositions = NULL;
+  curFrame = 0;
+  
+  // A fresh buffer every time since storage can't be resized.
+  positionBuffer = ofBufferObject();
+  isPersistent = ofIsGLProgrammableRenderer() && ofGLCheckExtension("GL_ARB_buffer_storage");
+  
+  if (isPersistent) {
+    GLsizeiptr bytes = numFrames * numVertices * sizeof(glm::vec2);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    positionBuffer.allocate();
+    positionBuffer.bind(GL_ARRAY_BUFFER);
+    glBufferStorage(GL_ARRAY_BUFFER, bytes, NULL, flags);
+    positionBuffer.unbind(GL_ARRAY_BUFFER);
+    mappedPositions = (glm::vec2 *) positionBuffer.mapRange(0, bytes, flags);
+    // Mapping failed, stream the old way.
+    isPersistent = mappedPositions != NULL;
+  }
+  
+  if (!isPersistent) {
+    positionBuffer = ofBufferObject();
+    positionBuffer.allocate(numVertices * sizeof(glm::vec2), GL_STREAM_DRAW);
+  }
+  
+  // Static buffers are shared, this mesh only owns its positions.
+  vbo.setVertexBuffer(positionBuffer, 2, sizeof(glm::vec2));
+  vbo.setTexCoordBuffer(topology->getTexCoordBuffer(), sizeof(glm::vec2));
+  vbo.setIndexBuffer(topology->getIndexBuffer());
+  isAllocated = true;
+}
+
+void GridMesh::draw(const std::vector<glm::vec3> &positions) {
+  if (!isAllocated || positions.size() != numVertices) {
+    allocate(positions.size());
+  }
+  
+  GLsizeiptr bytes = numVertices * sizeof(glm::vec2);
+  if (isPersistent) {
+    // Wait till the GPU is done with the frame we're about to overwrite. With 3
+    // frames in flight this almost never blocks.
+    if (fences[curFrame]) {
+      glClientWaitSync(fences[curFrame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      glDeleteSync(fences[curFrame]);
+      fences[curFrame] = NULL;
+    }
+    
+    packPositions(positions.data(), numVertices, mappedPositions + curFrame * numVertices);
+    vbo.setVertexBuffer(positionBuffer, 2, sizeof(glm::vec2), curFrame * bytes);
+    vbo.drawElements(GL_TRIANGLES, topology->getIndices().size());
+    
+    fences[curFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    curFrame = (curFrame + 1) % numFrames;
+  } else {
+    // Orphan last frame's storage so the driver doesn't stall on it, then write straight into the new one.
+    auto dst = (glm::vec2 *) positionBuffer.mapRange(0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst) {
+      packPositions(positions.data(), numVertices, dst);
+      positionBuffer.unmap();
+    } else {
+      // Some drivers won't map, pack on the CPU and upload with glBufferSubData.
+      packedPositions.resize(numVertices);
+      packPositions(positions.data(), numVertices, packedPositions.data());
+      positionBuffer.updateData(0, bytes, packedPositions.data());
+    }
+    vbo.drawElements(GL_TRIANGLES, topology->getIndices().size());
+  }
+}
+
+void GridMesh::releaseFences() {
+  for (int i = 0; i < numFrames; i++) {
+    if (fences[i]) {
+      glDeleteSync(fences[i]);
+      fences[i] = NULL;
+    }
+  }
+}
+
+void GridMesh::packPositions(const glm::vec3 *src, size_t n, glm::vec2 *dst) {
+  for (size_t i = 0; i < n; i++) {
+    dst[i].x = src[i].x;
+    dst[i].y = src[i].y;
+  }
+}
+
+float GridMesh::benchmarkPacking(int n, int iterations) {
+  std::vector<glm::vec3> src(n);
+  std::vector<glm::vec2> dst(n);
+  for (int i = 0; i < n; i++) {
+    src[i] = glm::vec3(ofRandom(1024), ofRandom(768), 0);
+  }
+  
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    packPositions(src.data(), n, dst.data());
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  
+  // Keep the result alive so the loop isn't optimized away.
+  volatile float sink = dst[n / 2].x;
+  (void) sink;
+  
+  return std::chrono::duration<float, std::micro>(end - start).count() / iterations;
+}
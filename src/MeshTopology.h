@@ -0,0 +1,70 @@
+// Triangle indices and texture coordinates of a rows x cols grid. They only depend on
+// the dimensions, so every mesh with the same dimensions (agents of the same size, the
+// background) shares one copy, on the CPU and on the GPU.
+
+#pragma once
+#include "ofMain.h"
+
+class MeshTopology {
+  public:
+    static std::shared_ptr<MeshTopology> get(int rows, int cols);
+  
+    int getRows();
+    int getCols();
+    const std::vector<ofIndexType> &getIndices();
+    const std::vector<glm::vec2> &getTexCoords(); // Normalized (0 - 1)
+  
+    // GPU copies, uploaded on first use.
+    ofBufferObject &getIndexBuffer();
+    ofBufferObject &getTexCoordBuffer();
+  
+  private:
+    MeshTopology(int rows, int cols);
+  
+    int rows, cols;
+    std::vector<ofIndexType> indices;
+    std::vector<glm::vec2> texCoords;
+  
+    bool isUploaded;
+    ofBufferObject indexBuffer;
+    ofBufferObject texCoordBuffer;
+  
+    // Topologies stay around as long as a mesh uses them.
+    static std::map<std::pair<int, int>, std::weak_ptr<MeshTopology>> cache;
+};
+
+// Draws per mesh positions with a shared topology. Only the positions are streamed every
+// frame, packed to xy (the meshes are flat). With buffer storage available they go into a
+// persistently mapped ring of frames, otherwise the buffer is orphaned and mapped each frame
+// (or updated with glBufferSubData when mapping fails).
+class GridMesh {
+  public:
+    ~GridMesh();
+  
+    void setup(std::shared_ptr<MeshTopology> topology);
+    void draw(const std::vector<glm::vec3> &positions);
+  
+    // CPU side of the stream, no GL involved.
+    static void packPositions(const glm::vec3 *src, size_t numVertices, glm::vec2 *dst);
+    // Average microseconds to pack a mesh of numVertices (run headless with --bench-packing).
+    static float benchmarkPacking(int numVertices, int iterations);
+  
+  private:
+    void allocate(size_t numVertices);
+    void releaseFences();
+  
+    static const int numFrames = 3; // Ring size for the persistent path.
+  
+    std::shared_ptr<MeshTopology> topology;
+    ofVbo vbo;
+    ofBufferObject positionBuffer;
+    size_t numVertices = 0;
+    bool isAllocated = false;
+    std::vector<glm::vec2> packedPositions; // Upload copy when the buffer can't be mapped.
+  
+    // Persistent mapping.
+    bool isPersistent = false;
+    glm::vec2 *mappedPositions = NULL;
+    GLsync fences[numFrames] = {};
+    int curFrame = 0;
+};
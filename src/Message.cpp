@@ -4,12 +4,12 @@ Message::Message(glm::vec2 loc, ofColor col, float s, string msg) {
   location = loc;
   color = col;
   size = s;
-  message = msg;
+  text = StringPool::instance().intern(msg);
   angle = ofRandom(-60, 60);
 }
 
-void Message::draw(ofTrueTypeFont font) {
-  if (message == "~") { // Draw bogus circle message.
+void Message::draw(ofTrueTypeFont font) const {
+  if (isBogus()) { // Draw bogus circle message.
     ofPushMatrix();
     ofTranslate(location);
       ofPushStyle();
@@ -21,10 +21,28 @@ void Message::draw(ofTrueTypeFont font) {
   } else { // Draw actual string message.
     ofPushMatrix();
       ofTranslate(location);
+      ofScale(size, size);
       ofPushStyle();
         ofSetColor(color);
-        font.drawString(message, 0, 0);
+        font.drawString(getText(), 0, 0);
       ofPopStyle();
     ofPopMatrix();
   }
 }
+
+void Message::draw(SoftRaster &raster, const SoftFont &font) const {
+  if (isBogus()) {
+    raster.drawCircle(location, size, ofColor(color, 250));
+  } else {
+    raster.drawString(font, getText(), location, 0, color, size);
+  }
+}
+
+const string &Message::getText() const {
+  return StringPool::instance().get(text);
+}
+
+bool Message::isBogus() const {
+  static StringId bogus = StringPool::instance().intern("~");
+  return text == bogus;
+}
@@ -3,15 +3,21 @@
 
 #pragma once
 #include "ofMain.h"
+#include "SoftRaster.h"
+#include "StringPool.h"
 
 class Message {
   public:
     Message(glm::vec2 loc, ofColor col, float size, string msg);
-    void draw(ofTrueTypeFont font);
+    void draw(ofTrueTypeFont font) const;
+    void draw(SoftRaster &raster, const SoftFont &font) const; // CPU version.
+    const string &getText() const;
+    bool isBogus() const; // Circle instead of text.
   
-    glm::vec2 location;
+    glm::vec2 location; // Circle center, or the text's baseline.
     ofColor color;
-    float size;
-    string message;
+    float size; // Circle radius, or the font scale for text.
+    ofRectangle slot; // Packed box of a text message, whatever text it has is fitted in it.
+    StringId text; // In the StringPool, swaps only move the handle.
     float angle;
 };
@@ -0,0 +1,112 @@
+#include "MessageStore.h"
+
+MessageHandle MessageStore::add(const Message &m) {
+  MessageHandle h = messages.size();
+  int kind = m.isBogus() ? 0 : 1;
+  messages.push_back(m);
+  texts.push_back(kind == 1);
+  handles[kind].push_back(h);
+  
+  // Never swapped, goes to the back of the line.
+  prev.push_back(tail[kind]);
+  next.push_back(-1);
+  if (tail[kind] >= 0) {
+    next[tail[kind]] = h;
+  } else {
+    head[kind] = h;
+  }
+  tail[kind] = h;
+  return h;
+}
+
+Message &MessageStore::get(MessageHandle h) {
+  return messages[h];
+}
+
+bool MessageStore::isText(MessageHandle h) {
+  return texts[h];
+}
+
+int MessageStore::size() const {
+  return messages.size();
+}
+
+size_t MessageStore::getBytes() {
+  // Strings are in the pool.
+  return messages.capacity() * sizeof(Message) + texts.capacity() / 8
+    + (handles[0].capacity() + handles[1].capacity() + prev.capacity() + next.capacity()) * sizeof(MessageHandle);
+}
+
+std::vector<Message>::const_iterator MessageStore::begin() const {
+  return messages.begin();
+}
+
+std::vector<Message>::const_iterator MessageStore::end() const {
+  return messages.end();
+}
+
+MessageHandle MessageStore::pick(MessageSelection selection) {
+  if (messages.empty()) {
+    return -1;
+  }
+  
+  // Kind first, then a message of that kind.
+  float numCircles = handles[0].size();
+  float numTexts = handles[1].size() * (selection == TextFirst ? textWeight : 1);
+  bool text = ofRandom(0, numCircles + numTexts) >= numCircles;
+  if (handles[text].empty()) {
+    text = !text;
+  }
+  return pick(selection, text);
+}
+
+MessageHandle MessageStore::pick(MessageSelection selection, bool text) {
+  auto &kind = handles[text];
+  if (kind.empty()) {
+    return -1;
+  }
+  
+  if (selection == LeastRecentlySwapped) {
+    return head[text];
+  }
+  
+  // The old ofRandom(0, size - 1) never picked the last one.
+  return kind[std::min((int) ofRandom(0, kind.size()), (int) kind.size() - 1)];
+}
+
+bool MessageStore::swap(MessageStore &a, MessageHandle ha, MessageStore &b, MessageHandle hb) {
+  if (a.texts[ha] != b.texts[hb]) {
+    return false;
+  }
+  
+  // The slots stay, only what's in them moves.
+  auto &ma = a.messages[ha];
+  auto &mb = b.messages[hb];
+  std::swap(ma.text, mb.text);
+  std::swap(ma.color, mb.color);
+  
+  a.touch(ha);
+  b.touch(hb);
+  return true;
+}
+
+void MessageStore::touch(MessageHandle h) {
+  int kind = texts[h];
+  if (h == tail[kind]) {
+    return;
+  }
+  
+  // Unlink.
+  if (prev[h] >= 0) {
+    next[prev[h]] = next[h];
+  } else {
+    head[kind] = next[h];
+  }
+  prev[next[h]] = prev[h];
+  
+  // Back of the line.
+  prev[h] = tail[kind];
+  next[h] = -1;
+  next[tail[kind]] = h;
+  tail[kind] = h;
+}
@@ -0,0 +1,50 @@
+// An agent's messages. Handles are indices and messages are never removed, so a handle
+// stays valid when the store grows (iterators didn't). A message is a slot on the texture:
+// swaps only move the text and color between slots of the same kind (circle or text), the
+// location, size and packed box stay, so the layout never changes. Nothing is allocated.
+// The next message to swap is picked with one of the selection strategies in O(1).
+
+#pragma once
+#include "ofMain.h"
+#include "Message.h"
+
+typedef int MessageHandle;
+
+enum MessageSelection {
+  Uniform = 0,
+  TextFirst, // Real text is textWeight times as likely as a bogus circle.
+  LeastRecentlySwapped
+};
+
+class MessageStore {
+  public:
+    MessageHandle add(const Message &m);
+    Message &get(MessageHandle h);
+    bool isText(MessageHandle h);
+    int size() const;
+    size_t getBytes();
+  
+    std::vector<Message>::const_iterator begin() const;
+    std::vector<Message>::const_iterator end() const;
+  
+    // -1 when there's nothing to pick.
+    MessageHandle pick(MessageSelection selection);
+    MessageHandle pick(MessageSelection selection, bool text); // Only that kind.
+  
+    // Exchanges what the two messages say. False (and nothing changes) if they aren't the same kind.
+    static bool swap(MessageStore &a, MessageHandle ha, MessageStore &b, MessageHandle hb);
+  
+    static const int textWeight = 8;
+  
+  private:
+    void touch(MessageHandle h); // Most recently swapped.
+  
+    std::vector<Message> messages;
+    std::vector<bool> texts; // Kind of every slot, it never changes.
+    std::vector<MessageHandle> handles[2]; // By kind (circles, texts).
+  
+    // Swap order per kind, least recent at the head (linked by handle).
+    std::vector<MessageHandle> prev, next;
+    MessageHandle head[2] = {-1, -1};
+    MessageHandle tail[2] = {-1, -1};
+};
@@ -0,0 +1,19 @@
+// Typed copy of the GUI parameters. ofApp publishes a new one when any parameter changed
+// (at most once per frame), so the hot paths read plain fields instead of looking parameters
+// up by name. The version goes up with every publish, anything derived from an older version
+// is stale.
+
+#pragma once
+#include "ofMain.h"
+#include "Agent.h"
+#include "BgMesh.h"
+
+struct Params {
+  unsigned long version = 0;
+  AgentProperties agent;
+  LodProperties lod;
+  bool batchForces = true; // Agents apply all their forces in one loop.
+  bool limitInStep = false; // Velocity clamp in the shard's step instead of the agent's update.
+  MessageSelection messageSelection = Uniform; // Next message to swap.
+  BgProperties bg;
+};
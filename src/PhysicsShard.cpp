@@ -0,0 +1,134 @@
+#include "PhysicsShard.h"
+#include "Agent.h"
+
+PhysicsShard::PhysicsShard(ofRectangle bounds, bool isThreaded) {
+  box2d.init();
+  box2d.setGravity(0, 0.0);
+  box2d.enableEvents();
+  box2d.registerGrabbing(); // Enable grabbing the circles.
+  box2d.createBounds(bounds);
+  
+  ofAddListener(box2d.contactEndEvents, this, &PhysicsShard::contactEnd);
+  
+  stepTime = 0;
+  threaded = isThreaded;
+  running = true;
+  stepRequested = false;
+  stepDone = true;
+  
+  if (threaded) {
+    worker = std::thread(&PhysicsShard::threadedFunction, this);
+  }
+}
+
+PhysicsShard::~PhysicsShard() {
+  if (threaded) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      running = false;
+    }
+    condition.notify_all();
+    worker.join();
+  }
+  
+  box2d.disableEvents();
+  ofRemoveListener(box2d.contactEndEvents, this, &PhysicsShard::contactEnd);
+  
+  // Parked lattices can't outlive their world.
+  SoftBodyPool::instance().clearWorld(box2d.getWorld());
+}
+
+void PhysicsShard::startStep(StepSettings settings) {
+  contacts.clear();
+  stepSettings = settings;
+  
+  if (!threaded) {
+    step();
+    return;
+  }
+  
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stepRequested = true;
+    stepDone = false;
+  }
+  condition.notify_all();
+}
+
+void PhysicsShard::waitForStep() {
+  if (!threaded) {
+    return;
+  }
+  
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [&] { return stepDone; });
+}
+
+bool PhysicsShard::isThreaded() {
+  return threaded;
+}
+
+void PhysicsShard::contactEnd(ofxBox2dContactArgs &e) {
+  // Runs inside the step, so only this shard's worker touches it.
+  contacts.push_back(e);
+}
+
+void PhysicsShard::step() {
+  auto start = ofGetElapsedTimeMicros();
+  box2d.setFPS(1.f / stepSettings.timeStep);
+  box2d.setIterations(stepSettings.velocityIterations, stepSettings.positionIterations);
+  // Forces from this frame's behaviors act on every substep. Without a step
+  // (time scale below 1) they wait for the next one, so one-shot forces like
+  // tickles and contact reactions aren't lost.
+  box2d.getWorld()->SetAutoClearForces(false);
+  for (int i = 0; i < stepSettings.substeps; i++) {
+    box2d.update();
+    
+    // Box2D has no per body solver hook, so right after the substep (on this worker).
+    if (stepSettings.limitVelocities) {
+      for (auto a : agents) {
+        a->limitVelocities();
+      }
+    }
+  }
+  if (stepSettings.substeps > 0) {
+    box2d.getWorld()->ClearForces();
+  }
+  stepTime = (ofGetElapsedTimeMicros() - start) / 1000.f;
+}
+
+void PhysicsShard::threadedFunction() {
+  // NOTE: Each world has its own allocators, so worlds can step in parallel. Box2D's
+  // global profiling counters are redirected to per thread storage (below).
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [&] { return stepRequested || !running; });
+      if (!running) {
+        return;
+      }
+      stepRequested = false;
+    }
+    
+    step();
+    
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stepDone = true;
+    }
+    condition.notify_all();
+  }
+}
+
+// Box2D's profiling counters (b2_gjkCalls, b2_toiCalls, ...) are plain globals written
+// inside every step. config.make defines each of them as one of these, so every worker
+// writes its own copy. We never read them.
+int *b2ThreadCounter() {
+  thread_local int counter;
+  return &counter;
+}
+
+float *b2ThreadTimer() {
+  thread_local float timer;
+  return &timer;
+}
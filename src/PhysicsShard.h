@@ -0,0 +1,53 @@
+// An independent Box2D world holding an island of agents that can currently touch
+// each other. Every shard is stepped on its own worker thread. ofApp merges shards when
+// their agents approach each other and splits them again when they drift apart.
+
+#pragma once
+#include "ofMain.h"
+#include "ofxBox2d.h"
+#include "SoftBodyPool.h"
+
+class Agent;
+
+// How a shard steps this frame. ofApp's fixed timestep accumulator
+// decides the number of substeps.
+struct StepSettings {
+  float timeStep = 1.f / 60.f;
+  int substeps = 1;
+  int velocityIterations = 40;
+  int positionIterations = 20;
+  bool limitVelocities = false; // Agents clamp their velocities after every substep.
+};
+
+class PhysicsShard {
+  public:
+    PhysicsShard(ofRectangle bounds, bool threaded);
+    ~PhysicsShard();
+  
+    // Step on the worker (or inline when not threaded).
+    void startStep(StepSettings settings);
+    void waitForStep();
+    bool isThreaded(); // Else it steps inline in startStep.
+  
+    // Collected on the worker during the step, handled on the main thread.
+    void contactEnd(ofxBox2dContactArgs &e);
+    std::vector<ofxBox2dContactArgs> contacts;
+  
+    ofxBox2d box2d;
+    std::vector<Agent *> agents;
+    float stepTime; // Milliseconds spent in the last step (all substeps).
+  
+  private:
+    void threadedFunction();
+    void step();
+  
+    StepSettings stepSettings;
+  
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool threaded;
+    bool running;
+    bool stepRequested;
+    bool stepDone;
+};
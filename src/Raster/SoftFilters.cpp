@@ -0,0 +1,314 @@
+#include "SoftFilters.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// ------------------------------ SoftFilter ------------------------------
+
+void SoftFilter::apply(ofPixels &pixels) {
+  auto start = ofGetElapsedTimeMicros();
+  process(pixels);
+  time = (ofGetElapsedTimeMicros() - start) / 1000.f;
+}
+
+float SoftFilter::getTime() {
+  return time;
+}
+
+// ------------------------------ SoftPixellation ------------------------------
+
+SoftPixellation::SoftPixellation(int size) {
+  pixelSize = size;
+}
+
+string SoftPixellation::getName() {
+  return "Pixellation";
+}
+
+string SoftPixellation::getDescription() {
+  return "Pixellation " + ofToString(pixelSize);
+}
+
+void SoftPixellation::process(ofPixels &pixels) {
+  if (pixelSize <= 1) {
+    return;
+  }
+
+  // Blocks can straddle tiles, so read from the original.
+  ofPixels result;
+  result.allocate(pixels.getWidth(), pixels.getHeight(), OF_PIXELS_RGBA);
+  int w = pixels.getWidth(), h = pixels.getHeight();
+  auto src = pixels.getData();
+  auto dst = result.getData();
+  int size = pixelSize;
+
+  SoftRaster::forEachTile(w, h, [=](int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+      int sy = std::min(h - 1, (y / size) * size + size / 2);
+      auto srcRow = (const uint32_t *) (src + sy * w * 4);
+      auto dstRow = (uint32_t *) (dst + y * w * 4);
+      // Whole pixels at a time, the compiler turns runs of the same block into stores.
+      for (int x = x0; x < x1; x++) {
+        dstRow[x] = srcRow[std::min(w - 1, (x / size) * size + size / 2)];
+      }
+    }
+  });
+
+  pixels.swap(result);
+}
+
+// ------------------------------ SoftLookup ------------------------------
+
+SoftLookup::SoftLookup(string file) {
+  lookupFile = file;
+
+  // Where every 8 bit value falls between the 64 table entries (value * 63 / 255).
+  for (int v = 0; v < 256; v++) {
+    int pos = v * 63 * 256 / 255;
+    index[v] = pos >> 8;
+    weight[v] = pos & 255;
+  }
+
+  ofPixels lut;
+  if (!ofLoadImage(lut, lookupFile) || lut.getWidth() != 512 || lut.getHeight() != 512) {
+    ofLogError("SoftLookup") << "Lookup needs a 512x512 image: " << lookupFile;
+    return;
+  }
+
+  // Unpack the 8x8 squares into a 3D table, blue picks the square.
+  int channels = lut.getNumChannels();
+  table.resize(64 * 64 * 64 * 3);
+  for (int b = 0; b < 64; b++) {
+    for (int g = 0; g < 64; g++) {
+      for (int r = 0; r < 64; r++) {
+        int px = (b % 8) * 64 + r;
+        int py = (b / 8) * 64 + g;
+        auto src = lut.getData() + (py * 512 + px) * channels;
+        auto dst = &table[((b * 64 + g) * 64 + r) * 3];
+        dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+      }
+    }
+  }
+}
+
+string SoftLookup::getName() {
+  return "Lookup";
+}
+
+string SoftLookup::getDescription() {
+  return "Lookup " + lookupFile;
+}
+
+size_t SoftLookup::getBytes() {
+  return table.capacity();
+}
+
+void SoftLookup::process(ofPixels &pixels) {
+  if (table.empty()) {
+    return;
+  }
+
+  int w = pixels.getWidth(), h = pixels.getHeight();
+  auto data = pixels.getData();
+  auto lut = table.data();
+  auto idx = index;
+  auto wt = weight;
+
+  // Table reads are scattered, so this one stays scalar (in fixed point).
+  SoftRaster::forEachTile(w, h, [=](int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        auto p = data + (y * w + x) * 4;
+        int r0 = idx[p[0]], g0 = idx[p[1]], b0 = idx[p[2]];
+        int r1 = std::min(r0 + 1, 63), g1 = std::min(g0 + 1, 63), b1 = std::min(b0 + 1, 63);
+        uint32_t wr = wt[p[0]], wg = wt[p[1]], wb = wt[p[2]];
+
+        auto at = [lut](int r, int g, int b) { return lut + ((b * 64 + g) * 64 + r) * 3; };
+        const unsigned char *c[8] = { at(r0, g0, b0), at(r1, g0, b0), at(r0, g1, b0), at(r1, g1, b0),
+                                      at(r0, g0, b1), at(r1, g0, b1), at(r0, g1, b1), at(r1, g1, b1) };
+        for (int ch = 0; ch < 3; ch++) {
+          // 8 bit weights, 24 bits of fraction at the end (fits in 32 bits).
+          uint32_t a0 = c[0][ch] * (256 - wr) + c[1][ch] * wr;
+          uint32_t a1 = c[2][ch] * (256 - wr) + c[3][ch] * wr;
+          uint32_t a2 = c[4][ch] * (256 - wr) + c[5][ch] * wr;
+          uint32_t a3 = c[6][ch] * (256 - wr) + c[7][ch] * wr;
+          uint32_t lo = a0 * (256 - wg) + a1 * wg;
+          uint32_t hi = a2 * (256 - wg) + a3 * wg;
+          uint32_t v = lo * (256 - wb) + hi * wb;
+          p[ch] = (v + (1u << 23)) >> 24;
+        }
+      }
+    }
+  });
+}
+
+// ------------------------------ SoftPoissonBlend ------------------------------
+
+SoftPoissonBlend::SoftPoissonBlend(string file, float m, int iterations) {
+  textureFile = file;
+  mix = m;
+  numIterations = iterations;
+  width = height = 0;
+
+  if (ofLoadImage(texture, textureFile)) {
+    texture.setImageType(OF_IMAGE_COLOR_ALPHA);
+  } else {
+    ofLogError("SoftPoissonBlend") << "Couldn't load " << textureFile;
+  }
+}
+
+string SoftPoissonBlend::getName() {
+  return "Poisson Blend";
+}
+
+string SoftPoissonBlend::getDescription() {
+  return "Poisson Blend " + textureFile + " " + ofToString(mix) + " " + ofToString(numIterations);
+}
+
+size_t SoftPoissonBlend::getBytes() {
+  return texture.getTotalBytes() + scaledTexture.getTotalBytes();
+}
+
+void SoftPoissonBlend::process(ofPixels &pixels) {
+  if (!texture.isAllocated()) {
+    return;
+  }
+
+  width = pixels.getWidth();
+  height = pixels.getHeight();
+
+  // The shader samples the texture in 0 - 1, so it's stretched over the image.
+  if (scaledTexture.getWidth() != width || scaledTexture.getHeight() != height) {
+    scaledTexture = texture;
+    scaledTexture.resize(width, height, OF_INTERPOLATE_BILINEAR);
+  }
+
+  // Every iteration reads the last result (ping pong).
+  ofPixels result;
+  result.allocate(width, height, OF_PIXELS_RGBA);
+  for (int i = 0; i < numIterations; i++) {
+    auto src = pixels.getData();
+    auto tex = scaledTexture.getData();
+    auto dst = result.getData();
+    SoftRaster::forEachTile(width, height, [=](int x0, int y0, int x1, int y1) {
+      for (int y = y0; y < y1; y++) {
+        blendRow(src, tex, dst, y, x0, x1);
+      }
+    });
+    pixels.swap(result);
+  }
+}
+
+void SoftPoissonBlend::blendRow(const unsigned char *src, const unsigned char *tex, unsigned char *dst, int y, int x0, int x1) {
+  // Texture alpha times mix, as a 7 bit weight.
+  int mixQ = ofClamp(mix, 0, 1) * 128 + 0.5;
+  int w4 = width * 4;
+  int up = (y > 0 ? y - 1 : y) * w4;
+  int down = (y < height - 1 ? y + 1 : y) * w4;
+  int row = y * w4;
+
+  // GL_CLAMP_TO_EDGE at the borders, one pixel at a time.
+  auto blendPixel = [&](int x) {
+    int l = (x > 0 ? x - 1 : x) * 4, c = x * 4, r = (x < width - 1 ? x + 1 : x) * 4;
+    int wt = (tex[row + c + 3] * mixQ) >> 8;
+    for (int ch = 0; ch < 3; ch++) {
+      // Mean of the neighbors plus the texture's difference from its own mean (x4).
+      int sum = src[row + l + ch] + src[row + r + ch] + src[up + c + ch] + src[down + c + ch];
+      int sumTex = tex[row + l + ch] + tex[row + r + ch] + tex[up + c + ch] + tex[down + c + ch];
+      int grad = (sum - sumTex + 4 * tex[row + c + ch]) >> 2;
+      grad = std::min(std::max(grad, 0), 255);
+      int center = src[row + c + ch];
+      dst[row + c + ch] = center + (((grad - center) * wt) >> 7);
+    }
+    dst[row + c + 3] = src[row + c + 3];
+  };
+
+  int x = x0;
+#ifdef __SSE2__
+  // Two pixels per register (16 bit lanes), same fixed point math as blendPixel.
+  int start = std::max(x0, 1);
+  int end = std::min(x1, width - 1);
+  if (start > x) {
+    for (; x < start; x++) {
+      blendPixel(x);
+    }
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i maxValue = _mm_set1_epi16(255);
+  const __m128i mixV = _mm_set1_epi16(mixQ);
+  const __m128i rgbMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+  auto load = [&](const unsigned char *p) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) p), zero);
+  };
+
+  for (; x + 2 <= end; x += 2) {
+    int c = x * 4;
+    __m128i center = load(src + row + c);
+    __m128i sum = _mm_add_epi16(_mm_add_epi16(load(src + row + c - 4), load(src + row + c + 4)),
+                                _mm_add_epi16(load(src + up + c), load(src + down + c)));
+    __m128i texCenter = load(tex + row + c);
+    __m128i sumTex = _mm_add_epi16(_mm_add_epi16(load(tex + row + c - 4), load(tex + row + c + 4)),
+                                   _mm_add_epi16(load(tex + up + c), load(tex + down + c)));
+    __m128i grad = _mm_srai_epi16(_mm_add_epi16(_mm_sub_epi16(sum, sumTex), _mm_slli_epi16(texCenter, 2)), 2);
+    grad = _mm_min_epi16(_mm_max_epi16(grad, zero), maxValue);
+
+    // Broadcast each pixel's texture alpha, alpha lanes keep the source.
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(texCenter, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i wt = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(alpha, mixV), 8), rgbMask);
+
+    __m128i result = _mm_add_epi16(center, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(grad, center), wt), 7));
+    _mm_storel_epi64((__m128i *) (dst + row + c), _mm_packus_epi16(result, zero));
+  }
+#endif
+
+  for (; x < x1; x++) {
+    blendPixel(x);
+  }
+}
+
+// ------------------------------ SoftFilterChain ------------------------------
+
+SoftFilterChain::~SoftFilterChain() {
+  for (auto f : filters) {
+    delete f;
+  }
+}
+
+void SoftFilterChain::addFilter(SoftFilter *filter) {
+  filters.push_back(filter);
+}
+
+void SoftFilterChain::apply(ofPixels &pixels) {
+  for (auto f : filters) {
+    f->apply(pixels);
+  }
+}
+
+std::vector<SoftFilter *> &SoftFilterChain::getFilters() {
+  return filters;
+}
+
+string SoftFilterChain::getDescription() {
+  string description;
+  for (auto f : filters) {
+    description += f->getDescription() + ";";
+  }
+  return description;
+}
+
+float SoftFilterChain::getTime() {
+  float time = 0;
+  for (auto f : filters) {
+    time += f->getTime();
+  }
+  return time;
+}
+
+size_t SoftFilterChain::getBytes() {
+  size_t bytes = 0;
+  for (auto f : filters) {
+    bytes += f->getBytes();
+  }
+  return bytes;
+}
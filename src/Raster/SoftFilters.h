@@ -0,0 +1,93 @@
+// CPU versions of the ofxFilterLibrary filters we use (PerlinPixellation, Lookup, PoissonBlend).
+// They work on RGBA ofPixels, tile parallel, in fixed point, so the output is the same for any
+// number of threads and with or without SSE2. Every filter keeps the time of its last run.
+
+#pragma once
+#include "ofMain.h"
+#include "SoftRaster.h"
+
+class SoftFilter {
+  public:
+    virtual ~SoftFilter() {}
+    void apply(ofPixels &pixels); // Times the filter.
+
+    virtual string getName() = 0;
+    virtual string getDescription() = 0; // Name and parameters, for cache keys.
+    float getTime(); // ms, last apply.
+    virtual size_t getBytes() { return 0; } // Tables and textures it holds on to.
+
+  protected:
+    virtual void process(ofPixels &pixels) = 0;
+
+  private:
+    float time = 0;
+};
+
+// Blocks of pixelSize take the color at the block center.
+class SoftPixellation : public SoftFilter {
+  public:
+    SoftPixellation(int pixelSize);
+    string getName() override;
+    string getDescription() override;
+
+  protected:
+    void process(ofPixels &pixels) override;
+
+  private:
+    int pixelSize;
+};
+
+// 512x512 lookup image (8x8 squares of 64x64) turned into a 64x64x64 table. Trilinear like the shader.
+class SoftLookup : public SoftFilter {
+  public:
+    SoftLookup(string lookupFile);
+    string getName() override;
+    string getDescription() override;
+    size_t getBytes() override;
+
+  protected:
+    void process(ofPixels &pixels) override;
+
+  private:
+    string lookupFile;
+    std::vector<unsigned char> table; // rgb, indexed by (b * 64 + g) * 64 + r
+    int index[256]; // 8 bit channel to table index
+    int weight[256]; // and fraction towards the next one (0 - 256).
+};
+
+// Mixes in the gradients of a texture (same formula as GPUImage's poisson blend, repeated numIterations).
+class SoftPoissonBlend : public SoftFilter {
+  public:
+    SoftPoissonBlend(string textureFile, float mix, int numIterations);
+    string getName() override;
+    string getDescription() override;
+    size_t getBytes() override;
+
+  protected:
+    void process(ofPixels &pixels) override;
+
+  private:
+    void blendRow(const unsigned char *src, const unsigned char *tex, unsigned char *dst, int y, int x0, int x1);
+
+    string textureFile;
+    float mix;
+    int numIterations;
+    ofPixels texture; // Original size, scaled to the image on first use.
+    ofPixels scaledTexture;
+    int width, height;
+};
+
+class SoftFilterChain {
+  public:
+    ~SoftFilterChain();
+    void addFilter(SoftFilter *filter); // Takes ownership.
+    void apply(ofPixels &pixels);
+
+    std::vector<SoftFilter *> &getFilters();
+    string getDescription();
+    float getTime(); // ms, all filters.
+    size_t getBytes();
+
+  private:
+    std::vector<SoftFilter *> filters;
+};
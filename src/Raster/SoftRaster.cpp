@@ -0,0 +1,311 @@
+#include "SoftRaster.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// ------------------------------ SoftFont ------------------------------
+
+bool SoftFont::load(string fileName, int fontSize, int dpi) {
+  glyphs.clear();
+  loaded = false;
+
+  FT_Library library;
+  if (FT_Init_FreeType(&library)) {
+    ofLogError("SoftFont") << "Couldn't initialize FreeType";
+    return false;
+  }
+
+  FT_Face face;
+  if (FT_New_Face(library, ofToDataPath(fileName, true).c_str(), 0, &face)) {
+    ofLogError("SoftFont") << "Couldn't load " << fileName;
+    FT_Done_FreeType(library);
+    return false;
+  }
+
+  FT_Set_Char_Size(face, fontSize << 6, fontSize << 6, dpi, dpi);
+  lineHeight = face->size->metrics.height / 64.f;
+
+  // Latin-1, same default range as ofTrueTypeFont.
+  for (uint32_t c = 32; c < 256; c++) {
+    if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
+      continue;
+    }
+
+    auto slot = face->glyph;
+    Glyph g;
+    g.width = slot->bitmap.width;
+    g.height = slot->bitmap.rows;
+    g.left = slot->bitmap_left;
+    g.top = slot->bitmap_top;
+    g.advance = slot->advance.x / 64.f;
+    g.coverage.resize(g.width * g.height);
+    for (int y = 0; y < g.height; y++) {
+      memcpy(&g.coverage[y * g.width], slot->bitmap.buffer + y * slot->bitmap.pitch, g.width);
+    }
+    glyphs[c] = std::move(g);
+  }
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+  loaded = true;
+  return true;
+}
+
+bool SoftFont::isLoaded() const {
+  return loaded;
+}
+
+const SoftFont::Glyph *SoftFont::getGlyph(uint32_t c) const {
+  auto it = glyphs.find(c);
+  return it == glyphs.end() ? NULL : &it->second;
+}
+
+float SoftFont::getLineHeight() const {
+  return lineHeight;
+}
+
+// ------------------------------ SoftRaster ------------------------------
+
+void SoftRaster::allocate(int width, int height) {
+  pixels.allocate(width, height, OF_PIXELS_RGBA);
+  commands.clear();
+}
+
+int SoftRaster::getWidth() const {
+  return pixels.getWidth();
+}
+
+int SoftRaster::getHeight() const {
+  return pixels.getHeight();
+}
+
+void SoftRaster::clear(ofColor color) {
+  Command cmd;
+  cmd.type = Clear;
+  cmd.color = color;
+  cmd.bounds = ofRectangle(0, 0, getWidth(), getHeight());
+  commands.push_back(cmd);
+}
+
+void SoftRaster::drawCheckerboard(int rectWidth, int rectHeight, ofColor even, ofColor odd) {
+  Command cmd;
+  cmd.type = Checkerboard;
+  cmd.color = even;
+  cmd.color2 = odd;
+  cmd.rectWidth = rectWidth;
+  cmd.rectHeight = rectHeight;
+  // Only whole rectangles are drawn, like BgMesh does.
+  int numCols = getWidth() / rectWidth;
+  int numRows = getHeight() / rectHeight;
+  cmd.bounds = ofRectangle(0, 0, numCols * rectWidth, numRows * rectHeight);
+  commands.push_back(cmd);
+}
+
+void SoftRaster::drawCircle(glm::vec2 center, float radius, ofColor color) {
+  Command cmd;
+  cmd.type = Circle;
+  cmd.color = color;
+  cmd.pos = center;
+  cmd.radius = radius;
+  cmd.bounds = ofRectangle(center.x - radius - 1, center.y - radius - 1, radius * 2 + 2, radius * 2 + 2);
+  commands.push_back(cmd);
+}
+
+void SoftRaster::drawString(const SoftFont &font, string text, glm::vec2 pos, float angle, ofColor color, float scale) {
+  float cosA = cos(ofDegToRad(angle));
+  float sinA = sin(ofDegToRad(angle));
+
+  // Pen position in the rotated text space.
+  glm::vec2 pen(0, 0);
+  for (int i = 0; i < text.size(); i++) {
+    // Decode UTF-8, anything outside the loaded range is skipped.
+    uint32_t c = (unsigned char) text[i];
+    if (c >= 0xC0 && c < 0xE0 && i + 1 < text.size()) {
+      c = ((c & 0x1F) << 6) | ((unsigned char) text[++i] & 0x3F);
+    } else if (c >= 0xE0) {
+      while (i + 1 < text.size() && ((unsigned char) text[i + 1] & 0xC0) == 0x80) {
+        i++;
+      }
+      continue;
+    }
+
+    if (c == '\n') {
+      pen.x = 0;
+      pen.y += font.getLineHeight() * scale;
+      continue;
+    }
+
+    auto g = font.getGlyph(c);
+    if (!g) {
+      continue;
+    }
+
+    if (g->width > 0 && g->height > 0) {
+      Command cmd;
+      cmd.type = Glyph;
+      cmd.color = color;
+      cmd.glyph = g;
+      cmd.cosA = cosA;
+      cmd.sinA = sinA;
+      cmd.scale = scale;
+      // Top left of the glyph bitmap in raster space.
+      glm::vec2 local(pen.x + g->left * scale, pen.y - g->top * scale);
+      cmd.pos = pos + glm::vec2(local.x * cosA - local.y * sinA, local.x * sinA + local.y * cosA);
+
+      // Bounds of the rotated bitmap.
+      float minX = cmd.pos.x, maxX = cmd.pos.x, minY = cmd.pos.y, maxY = cmd.pos.y;
+      glm::vec2 corners[3] = { {g->width * scale, 0}, {0, g->height * scale}, {g->width * scale, g->height * scale} };
+      for (auto corner : corners) {
+        auto p = cmd.pos + glm::vec2(corner.x * cosA - corner.y * sinA, corner.x * sinA + corner.y * cosA);
+        minX = std::min(minX, p.x); maxX = std::max(maxX, p.x);
+        minY = std::min(minY, p.y); maxY = std::max(maxY, p.y);
+      }
+      cmd.bounds = ofRectangle(minX - 1, minY - 1, maxX - minX + 2, maxY - minY + 2);
+      commands.push_back(cmd);
+    }
+
+    pen.x += g->advance * scale;
+  }
+}
+
+void SoftRaster::render() {
+  forEachTile(getWidth(), getHeight(), [this](int x0, int y0, int x1, int y1) {
+    ofRectangle tile(x0, y0, x1 - x0, y1 - y0);
+    // Commands keep their order inside a tile, so blending matches the GPU.
+    for (auto &cmd : commands) {
+      if (cmd.bounds.intersects(tile)) {
+        rasterize(cmd, x0, y0, x1, y1);
+      }
+    }
+  });
+
+  commands.clear();
+}
+
+void SoftRaster::rasterize(const Command &cmd, int x0, int y0, int x1, int y1) {
+  int w = getWidth();
+  auto data = pixels.getData();
+
+  // Clip to the command.
+  int cx0 = std::max(x0, (int) floor(cmd.bounds.x));
+  int cy0 = std::max(y0, (int) floor(cmd.bounds.y));
+  int cx1 = std::min(x1, (int) ceil(cmd.bounds.getRight()));
+  int cy1 = std::min(y1, (int) ceil(cmd.bounds.getBottom()));
+
+  for (int y = cy0; y < cy1; y++) {
+    for (int x = cx0; x < cx1; x++) {
+      auto dst = data + (y * w + x) * 4;
+      switch (cmd.type) {
+        case Clear: {
+          dst[0] = cmd.color.r; dst[1] = cmd.color.g; dst[2] = cmd.color.b; dst[3] = cmd.color.a;
+          break;
+        }
+
+        case Checkerboard: {
+          // Every row shifts the pattern by one extra rectangle.
+          int numCols = w / cmd.rectWidth;
+          int col = x / cmd.rectWidth;
+          int row = y / cmd.rectHeight;
+          int a = row * numCols + col + row;
+          blend(dst, a % 2 == 0 ? cmd.color : cmd.color2, 1);
+          break;
+        }
+
+        case Circle: {
+          // Coverage from the distance of the pixel center to the edge.
+          float d = glm::distance(glm::vec2(x + 0.5, y + 0.5), cmd.pos);
+          float coverage = ofClamp(cmd.radius - d + 0.5, 0, 1);
+          if (coverage > 0) {
+            blend(dst, cmd.color, coverage);
+          }
+          break;
+        }
+
+        case Glyph: {
+          // Back to glyph space and sample the coverage bilinearly.
+          glm::vec2 p = glm::vec2(x + 0.5, y + 0.5) - cmd.pos;
+          float gx = (p.x * cmd.cosA + p.y * cmd.sinA) / cmd.scale - 0.5;
+          float gy = (-p.x * cmd.sinA + p.y * cmd.cosA) / cmd.scale - 0.5;
+          auto g = cmd.glyph;
+          if (gx <= -1 || gy <= -1 || gx >= g->width || gy >= g->height) {
+            break;
+          }
+
+          int ix = floor(gx), iy = floor(gy);
+          float fx = gx - ix, fy = gy - iy;
+          auto sample = [g](int sx, int sy) -> float {
+            if (sx < 0 || sy < 0 || sx >= g->width || sy >= g->height) {
+              return 0;
+            }
+            return g->coverage[sy * g->width + sx] / 255.f;
+          };
+          float coverage = ofLerp(ofLerp(sample(ix, iy), sample(ix + 1, iy), fx),
+                                  ofLerp(sample(ix, iy + 1), sample(ix + 1, iy + 1), fx), fy);
+          if (coverage > 0) {
+            blend(dst, cmd.color, coverage);
+          }
+          break;
+        }
+      }
+    }
+  }
+}
+
+void SoftRaster::blend(unsigned char *dst, const ofColor &src, float coverage) {
+  // GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA on all four channels.
+  float a = src.a / 255.f * coverage;
+  dst[0] = src.r * a + dst[0] * (1 - a) + 0.5;
+  dst[1] = src.g * a + dst[1] * (1 - a) + 0.5;
+  dst[2] = src.b * a + dst[2] * (1 - a) + 0.5;
+  dst[3] = src.a * a + dst[3] * (1 - a) + 0.5;
+}
+
+void SoftRaster::crop(int width, int height) {
+  width = std::min(width, getWidth());
+  height = std::min(height, getHeight());
+  ofPixels cropped;
+  cropped.allocate(width, height, OF_PIXELS_RGBA);
+  for (int y = 0; y < height; y++) {
+    memcpy(cropped.getData() + y * width * 4, pixels.getData() + y * getWidth() * 4, width * 4);
+  }
+  pixels.swap(cropped);
+}
+
+ofPixels &SoftRaster::getPixels() {
+  return pixels;
+}
+
+uint64_t SoftRaster::getHash() const {
+  uint64_t hash = 14695981039346656037ULL;
+  auto data = pixels.getData();
+  for (size_t i = 0; i < pixels.size(); i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void SoftRaster::forEachTile(int w, int h, std::function<void(int, int, int, int)> fn) {
+  int tilesX = (w + tileSize - 1) / tileSize;
+  int tilesY = (h + tileSize - 1) / tileSize;
+  int numTiles = tilesX * tilesY;
+
+  // Tiles don't overlap, so threads just grab the next one.
+  std::atomic<int> nextTile(0);
+  auto work = [&]() {
+    for (int t = nextTile++; t < numTiles; t = nextTile++) {
+      int x0 = (t % tilesX) * tileSize;
+      int y0 = (t / tilesX) * tileSize;
+      fn(x0, y0, std::min(x0 + tileSize, w), std::min(y0 + tileSize, h));
+    }
+  };
+
+  int numThreads = std::min((int) std::max(1u, std::thread::hardware_concurrency()), numTiles);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < numThreads; i++) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto &t : threads) {
+    t.join();
+  }
+}
@@ -0,0 +1,76 @@
+// CPU rasterizer for the textures that are usually drawn into FBOs (checkerboard background,
+// message circles and text). The filters are in SoftFilters.
+// Doesn't need a GL context, so the textures can be baked and hashed on machines without a GPU.
+// Draw calls are recorded, then render() rasterizes them tile by tile on all the cores.
+
+#pragma once
+#include "ofMain.h"
+
+// Glyph coverage from FreeType (what ofTrueTypeFont uses internally, minus the texture atlas).
+class SoftFont {
+  public:
+    struct Glyph {
+      int width = 0;
+      int height = 0;
+      int left = 0; // Offset from the pen position.
+      int top = 0; // Distance from the baseline to the top row.
+      float advance = 0;
+      std::vector<unsigned char> coverage;
+    };
+
+    bool load(string fileName, int fontSize, int dpi = 96);
+    bool isLoaded() const;
+    const Glyph *getGlyph(uint32_t c) const;
+    float getLineHeight() const;
+
+  private:
+    std::map<uint32_t, Glyph> glyphs;
+    float lineHeight = 0;
+    bool loaded = false;
+};
+
+class SoftRaster {
+  public:
+    void allocate(int width, int height);
+    int getWidth() const;
+    int getHeight() const;
+
+    // Recorded, rasterized on render(). Same blending as ofEnableAlphaBlending.
+    void clear(ofColor color);
+    void drawCheckerboard(int rectWidth, int rectHeight, ofColor even, ofColor odd);
+    void drawCircle(glm::vec2 center, float radius, ofColor color);
+    void drawString(const SoftFont &font, string text, glm::vec2 pos, float angle, ofColor color, float scale = 1);
+    void render();
+
+    // Top left corner of the raster (the drawSubsection we do on the GPU).
+    void crop(int width, int height);
+
+    ofPixels &getPixels();
+    uint64_t getHash() const; // FNV-1a of the pixels, for regression checks.
+
+    // Runs fn(x0, y0, x1, y1) for every tile of a width x height image, spread over the hardware threads.
+    static void forEachTile(int width, int height, std::function<void(int, int, int, int)> fn);
+    static const int tileSize = 64;
+
+  private:
+    enum CommandType { Clear, Checkerboard, Circle, Glyph };
+
+    struct Command {
+      CommandType type;
+      ofColor color;
+      ofColor color2;
+      glm::vec2 pos; // Circle center, glyph origin.
+      float radius;
+      int rectWidth, rectHeight;
+      const SoftFont::Glyph *glyph;
+      float cosA, sinA;
+      float scale; // Glyph pixels to raster pixels.
+      ofRectangle bounds; // Affected pixels.
+    };
+
+    void rasterize(const Command &cmd, int x0, int y0, int x1, int y1);
+    void blend(unsigned char *dst, const ofColor &src, float coverage);
+
+    std::vector<Command> commands;
+    ofPixels pixels;
+};
@@ -0,0 +1,31 @@
+#include "SimClock.h"
+
+void SimClock::advance(float dt) {
+  deltaTime = dt;
+  time += dt;
+}
+
+double SimClock::getTime() {
+  return time;
+}
+
+uint64_t SimClock::getTimeMillis() {
+  return time * 1000.0;
+}
+
+float SimClock::getDeltaTime() {
+  return deltaTime;
+}
+
+float SimClock::getLerpAmount(float amountPerFrame, float dt) {
+  // What's left after n frames is (1 - amount)^n.
+  return 1.f - pow(1.f - amountPerFrame, dt * 60.f);
+}
+
+SimClock &SimClock::instance() {
+  return c;
+}
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+SimClock SimClock::c;
@@ -0,0 +1,26 @@
+// Simulation time. It only moves with the physics (whole fixed steps), so everything that
+// ramps or counts down runs at the same speed at any frame rate or step rate, and faster
+// than real time when the time scale is up. Singleton like FrameArena.
+
+#pragma once
+#include "ofMain.h"
+
+class SimClock {
+  public:
+    void advance(float dt); // Called once per frame with the time that was stepped.
+  
+    double getTime(); // Seconds. Double, a float is ~8 ms coarse after a day.
+    uint64_t getTimeMillis();
+    float getDeltaTime(); // Last frame.
+  
+    // ofLerp amount for dt that matches amountPerFrame at the 60 fps everything was tuned at.
+    static float getLerpAmount(float amountPerFrame, float dt);
+  
+    static SimClock &instance();
+  
+  private:
+    double time = 0; // Double so millis stay exact over long shows.
+    float deltaTime = 0;
+  
+    static SimClock c;
+};
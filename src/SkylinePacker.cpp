@@ -0,0 +1,111 @@
+#include "SkylinePacker.h"
+
+void SkylinePacker::setup(int width, int height) {
+  binWidth = width;
+  binHeight = height;
+  usedArea = 0;
+  skyline.clear();
+  skyline.push_back({0, 0, width});
+}
+
+bool SkylinePacker::insert(int width, int height, glm::vec2 &pos) {
+  if (width <= 0 || height <= 0) {
+    return false;
+  }
+  
+  // Lowest spot, ties go to the left.
+  int best = -1, bestY = binHeight;
+  for (size_t i = 0; i < skyline.size(); i++) {
+    int y = fit(i, width, height);
+    if (y >= 0 && y < bestY) {
+      best = i; bestY = y;
+    }
+  }
+  
+  if (best < 0) {
+    return false;
+  }
+  
+  // New segment on top of the rectangle, the ones it covers shrink or go.
+  Segment s = {skyline[best].x, bestY + height, width};
+  skyline.insert(skyline.begin() + best, s);
+  int right = s.x + width;
+  size_t i = best + 1;
+  while (i < skyline.size() && skyline[i].x < right) {
+    int end = skyline[i].x + skyline[i].width;
+    if (end <= right) {
+      skyline.erase(skyline.begin() + i);
+    } else {
+      skyline[i].width = end - right;
+      skyline[i].x = right;
+      break;
+    }
+  }
+  
+  // Merge neighbors at the same height.
+  for (size_t j = 0; j + 1 < skyline.size();) {
+    if (skyline[j].y == skyline[j + 1].y) {
+      skyline[j].width += skyline[j + 1].width;
+      skyline.erase(skyline.begin() + j + 1);
+    } else {
+      j++;
+    }
+  }
+  
+  usedArea += (long) width * height;
+  pos = glm::vec2(s.x, bestY);
+  return true;
+}
+
+int SkylinePacker::fit(size_t idx, int width, int height) {
+  int x = skyline[idx].x;
+  if (x + width > binWidth) {
+    return -1;
+  }
+  
+  // Rests on the highest segment under it.
+  int y = 0;
+  int remaining = width;
+  for (size_t i = idx; remaining > 0; i++) {
+    y = std::max(y, skyline[i].y);
+    if (y + height > binHeight) {
+      return -1;
+    }
+    remaining -= skyline[i].width;
+  }
+  
+  return y;
+}
+
+float SkylinePacker::getOccupancy() {
+  return (float) usedArea / ((long) binWidth * binHeight);
+}
+
+int SkylinePacker::getNumSegments() {
+  return skyline.size();
+}
+
+float SkylinePacker::benchmark(int numRects, int iterations, int &numPlaced) {
+  // Text blocks of a few lines, in a square with room for about all of them.
+  std::vector<glm::vec2> sizes(numRects);
+  long area = 0;
+  for (auto &s : sizes) {
+    s = glm::vec2((int) ofRandom(20, 120), (int) ofRandom(8, 40));
+    area += s.x * s.y;
+  }
+  int side = sqrt(area) * 1.1;
+  
+  SkylinePacker packer;
+  glm::vec2 pos;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    packer.setup(side, side);
+    numPlaced = 0;
+    for (auto &s : sizes) {
+      numPlaced += packer.insert(s.x, s.y, pos);
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  
+  return std::chrono::duration<float, std::micro>(end - start).count() / iterations;
+}
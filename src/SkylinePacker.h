@@ -0,0 +1,30 @@
+// Bottom-left skyline packer for laying out messages on an agent's texture. The skyline is
+// the top edge of everything placed so far, a rectangle goes where it lands lowest (then
+// leftmost). Rectangles never overlap. An insert costs the number of skyline segments,
+// which stays small next to the number of rectangles, so thousands are cheap.
+
+#pragma once
+#include "ofMain.h"
+
+class SkylinePacker {
+  public:
+    void setup(int width, int height);
+    bool insert(int width, int height, glm::vec2 &pos); // Top left of the placed rectangle.
+  
+    float getOccupancy(); // Fraction of the area used.
+    int getNumSegments();
+  
+    // Average microseconds to pack numRects message sized rectangles (run headless with --bench-messages).
+    static float benchmark(int numRects, int iterations, int &numPlaced);
+  
+  private:
+    struct Segment {
+      int x, y, width;
+    };
+  
+    int fit(size_t idx, int width, int height); // Top of the rectangle at segment idx, -1 if it doesn't fit.
+  
+    std::vector<Segment> skyline;
+    int binWidth, binHeight;
+    long usedArea;
+};
@@ -0,0 +1,375 @@
+#include "Snapshot.h"
+
+// File layout: magic, version, then the sections in order. Everything little endian,
+// written as is (same machine reads it back).
+static const char magic[4] = {'F', 'G', 'S', 'N'};
+static const uint32_t version = 3;
+
+// ------------------------------ Serialization ------------------------------
+
+namespace {
+  struct Writer {
+    std::string bytes;
+
+    template<typename T> void write(const T &v) {
+      bytes.append((const char *) &v, sizeof(T));
+    }
+
+    void writeString(const string &s) {
+      write((uint32_t) s.size());
+      bytes.append(s);
+    }
+  };
+
+  struct Reader {
+    const char *data;
+    size_t size;
+    size_t pos = 0;
+    bool ok = true;
+
+    template<typename T> T read() {
+      T v{};
+      if (pos + sizeof(T) > size) {
+        ok = false;
+        return v;
+      }
+      memcpy(&v, data + pos, sizeof(T));
+      pos += sizeof(T);
+      return v;
+    }
+
+    string readString() {
+      auto n = read<uint32_t>();
+      if (!ok || pos + n > size) {
+        ok = false;
+        return "";
+      }
+      string s(data + pos, n);
+      pos += n;
+      return s;
+    }
+
+    // Guards the vector sizes against a corrupted file.
+    uint32_t readCount(size_t minBytesPerItem) {
+      auto n = read<uint32_t>();
+      if (!ok || n * minBytesPerItem > size - pos) {
+        ok = false;
+        return 0;
+      }
+      return n;
+    }
+  };
+
+  void writeBody(Writer &w, const BodyState &b) {
+    w.write(b.position.x); w.write(b.position.y); w.write(b.angle);
+    w.write(b.velocity.x); w.write(b.velocity.y); w.write(b.angularVelocity);
+    w.write((uint8_t) b.awake);
+  }
+
+  BodyState readBody(Reader &r) {
+    BodyState b;
+    b.position.x = r.read<float>(); b.position.y = r.read<float>(); b.angle = r.read<float>();
+    b.velocity.x = r.read<float>(); b.velocity.y = r.read<float>(); b.angularVelocity = r.read<float>();
+    b.awake = r.read<uint8_t>();
+    return b;
+  }
+
+  void writeProps(Writer &w, const AgentProperties &p) {
+    w.write(p.meshSize.x); w.write(p.meshSize.y);
+    w.write(p.meshDimensions.x); w.write(p.meshDimensions.y);
+    w.write(p.vertexPhysics.x); w.write(p.vertexPhysics.y); w.write(p.vertexPhysics.z);
+    w.write(p.jointPhysics.x); w.write(p.jointPhysics.y);
+    w.write(p.textureDimensions.x); w.write(p.textureDimensions.y);
+    w.write(p.meshOrigin.x); w.write(p.meshOrigin.y);
+    w.write(p.vertexRadius);
+    w.write((int32_t) p.interiorStep);
+    w.write((int32_t) p.textureSeed);
+    w.write((uint8_t) p.cpuTexture);
+  }
+
+  AgentProperties readProps(Reader &r) {
+    AgentProperties p;
+    p.meshSize.x = r.read<float>(); p.meshSize.y = r.read<float>();
+    p.meshDimensions.x = r.read<float>(); p.meshDimensions.y = r.read<float>();
+    p.vertexPhysics.x = r.read<float>(); p.vertexPhysics.y = r.read<float>(); p.vertexPhysics.z = r.read<float>();
+    p.jointPhysics.x = r.read<float>(); p.jointPhysics.y = r.read<float>();
+    p.textureDimensions.x = r.read<float>(); p.textureDimensions.y = r.read<float>();
+    p.meshOrigin.x = r.read<float>(); p.meshOrigin.y = r.read<float>();
+    p.vertexRadius = r.read<float>();
+    p.interiorStep = r.read<int32_t>();
+    p.textureSeed = r.read<int32_t>();
+    p.cpuTexture = r.read<uint8_t>();
+    return p;
+  }
+}
+
+bool Snapshot::save(string path) {
+  Writer w;
+  w.bytes.append(magic, 4);
+  w.write(version);
+  w.write(jointCounter);
+
+  // Agents.
+  w.write((uint32_t) agents.size());
+  for (auto &a : agents) {
+    w.writeString(a.messageFile);
+    writeProps(w, a.props);
+
+    w.write((uint32_t) a.refinedCells.size());
+    for (bool c : a.refinedCells) {
+      w.write((uint8_t) c);
+    }
+
+    w.write((uint32_t) a.vertices.size());
+    for (auto &v : a.vertices) {
+      w.write((int32_t) v.meshIdx);
+      writeBody(w, v.body);
+      w.write((uint8_t) (v.applyRepulsion | v.applyAttraction << 1 | v.hasInterAgentJoint << 2));
+      w.write(v.targetPos.x); w.write(v.targetPos.y);
+    }
+
+    w.write((uint32_t) a.messages->size());
+    for (auto &m : *a.messages) {
+      w.write(m.location.x); w.write(m.location.y);
+      w.write(m.color.r); w.write(m.color.g); w.write(m.color.b); w.write(m.color.a);
+      w.write(m.size);
+      w.write(m.angle);
+      w.write(m.slot.x); w.write(m.slot.y); w.write(m.slot.width); w.write(m.slot.height);
+      w.writeString(m.getText());
+    }
+
+    w.write((int32_t) a.curMsg);
+    w.write((int32_t) a.partner);
+    w.write((int32_t) a.desireState);
+    w.write(a.seekTargetPos.x); w.write(a.seekTargetPos.y);
+    w.write((uint8_t) (a.applyStretch | a.applyTickle << 1 | a.applyAttraction << 2 | a.applyRepulsion << 3));
+    w.write(a.stretchWeight); w.write(a.repulsionWeight); w.write(a.tickleWeight);
+  }
+
+  // Bonds.
+  w.write((uint32_t) superAgents.size());
+  for (auto &sa : superAgents) {
+    w.write((int32_t) sa.agentA); w.write((int32_t) sa.agentB);
+    w.write(sa.exchangeDelay); w.write(sa.exchangeInterval);
+    w.write((uint32_t) sa.joints.size());
+    for (auto &j : sa.joints) {
+      w.write((int32_t) j.agentA); w.write((int32_t) j.meshIdxA);
+      w.write((int32_t) j.agentB); w.write((int32_t) j.meshIdxB);
+      w.write(j.length); w.write(j.frequency); w.write(j.damping);
+      w.write(j.birth);
+    }
+  }
+
+  // Memories.
+  w.write((uint32_t) memories.size());
+  for (auto &m : memories) {
+    w.write(m.position.x); w.write(m.position.y);
+    w.write(m.velocity.x); w.write(m.velocity.y);
+    w.write(m.radius);
+    w.write(m.elapsedTime); w.write(m.maxTime);
+  }
+
+  // Temporary file first, so a crash mid write leaves the last good snapshot.
+  auto tmpPath = path + ".tmp";
+  std::ofstream file(tmpPath, std::ios::binary);
+  file.write(w.bytes.data(), w.bytes.size());
+  file.close();
+  if (!file) {
+    ofLogWarning("Snapshot") << "Couldn't write " << tmpPath;
+    return false;
+  }
+
+  return ofFile::moveFromTo(tmpPath, path, true, true);
+}
+
+bool Snapshot::load(string path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  Reader r;
+  r.data = bytes.data();
+  r.size = bytes.size();
+  if (r.size < 8 || memcmp(r.data, magic, 4) != 0) {
+    ofLogWarning("Snapshot") << path << " isn't a snapshot";
+    return false;
+  }
+  r.pos = 4;
+  if (r.read<uint32_t>() != version) {
+    ofLogWarning("Snapshot") << path << " is from another version";
+    return false;
+  }
+  jointCounter = r.read<uint64_t>();
+
+  agents.resize(r.readCount(1));
+  for (auto &a : agents) {
+    a.messageFile = r.readString();
+    a.props = readProps(r);
+
+    a.refinedCells.resize(r.readCount(1));
+    for (int i = 0; i < a.refinedCells.size(); i++) {
+      a.refinedCells[i] = r.read<uint8_t>();
+    }
+
+    a.vertices.resize(r.readCount(4));
+    for (auto &v : a.vertices) {
+      v.meshIdx = r.read<int32_t>();
+      v.body = readBody(r);
+      auto flags = r.read<uint8_t>();
+      v.applyRepulsion = flags & 1;
+      v.applyAttraction = flags & 2;
+      v.hasInterAgentJoint = flags & 4;
+      v.targetPos.x = r.read<float>(); v.targetPos.y = r.read<float>();
+    }
+
+    auto messages = std::make_shared<MessageStore>();
+    int numMessages = r.readCount(4);
+    for (int i = 0; i < numMessages && r.ok; i++) {
+      glm::vec2 location;
+      location.x = r.read<float>(); location.y = r.read<float>();
+      ofColor color;
+      color.r = r.read<unsigned char>(); color.g = r.read<unsigned char>();
+      color.b = r.read<unsigned char>(); color.a = r.read<unsigned char>();
+      float size = r.read<float>();
+      float angle = r.read<float>();
+      ofRectangle slot;
+      slot.x = r.read<float>(); slot.y = r.read<float>(); slot.width = r.read<float>(); slot.height = r.read<float>();
+      Message m(location, color, size, r.readString());
+      m.angle = angle;
+      m.slot = slot;
+      messages->add(m);
+    }
+    a.messages = messages;
+
+    a.curMsg = r.read<int32_t>();
+    a.partner = r.read<int32_t>();
+    a.desireState = r.read<int32_t>();
+    a.seekTargetPos.x = r.read<float>(); a.seekTargetPos.y = r.read<float>();
+    auto flags = r.read<uint8_t>();
+    a.applyStretch = flags & 1;
+    a.applyTickle = flags & 2;
+    a.applyAttraction = flags & 4;
+    a.applyRepulsion = flags & 8;
+    a.stretchWeight = r.read<float>(); a.repulsionWeight = r.read<float>(); a.tickleWeight = r.read<float>();
+  }
+
+  superAgents.resize(r.readCount(4));
+  for (auto &sa : superAgents) {
+    sa.agentA = r.read<int32_t>(); sa.agentB = r.read<int32_t>();
+    sa.exchangeDelay = r.read<float>(); sa.exchangeInterval = r.read<float>();
+    sa.joints.resize(r.readCount(4));
+    for (auto &j : sa.joints) {
+      j.agentA = r.read<int32_t>(); j.meshIdxA = r.read<int32_t>();
+      j.agentB = r.read<int32_t>(); j.meshIdxB = r.read<int32_t>();
+      j.length = r.read<float>(); j.frequency = r.read<float>(); j.damping = r.read<float>();
+      j.birth = r.read<uint64_t>();
+    }
+  }
+
+  memories.resize(r.readCount(4));
+  for (auto &m : memories) {
+    m.position.x = r.read<float>(); m.position.y = r.read<float>();
+    m.velocity.x = r.read<float>(); m.velocity.y = r.read<float>();
+    m.radius = r.read<float>();
+    m.elapsedTime = r.read<uint64_t>(); m.maxTime = r.read<uint64_t>();
+  }
+
+  if (!r.ok) {
+    ofLogWarning("Snapshot") << path << " is truncated";
+    return false;
+  }
+
+  // Agents are referenced by index, a corrupt file could point anywhere.
+  int numAgents = agents.size();
+  auto isAgent = [numAgents](int idx) { return idx >= 0 && idx < numAgents; };
+  bool valid = true;
+  for (auto &a : agents) {
+    valid &= a.partner == -1 || isAgent(a.partner);
+  }
+  for (auto &sa : superAgents) {
+    valid &= isAgent(sa.agentA) && isAgent(sa.agentB);
+    for (auto &j : sa.joints) {
+      valid &= isAgent(j.agentA) && isAgent(j.agentB);
+    }
+  }
+  if (!valid) {
+    ofLogWarning("Snapshot") << path << " references agents that aren't in it";
+    return false;
+  }
+
+  return true;
+}
+
+BodyState Snapshot::getBodyState(b2Body *body) {
+  BodyState state;
+  state.position = body->GetPosition();
+  state.angle = body->GetAngle();
+  state.velocity = body->GetLinearVelocity();
+  state.angularVelocity = body->GetAngularVelocity();
+  state.awake = body->IsAwake();
+  return state;
+}
+
+void Snapshot::setBodyState(b2Body *body, const BodyState &state) {
+  body->SetTransform(state.position, state.angle);
+  body->SetLinearVelocity(state.velocity);
+  body->SetAngularVelocity(state.angularVelocity);
+  body->SetAwake(state.awake);
+}
+
+// ------------------------------ SnapshotWriter ------------------------------
+
+SnapshotWriter::SnapshotWriter(string snapshotPath) {
+  path = snapshotPath;
+  numWritten = 0;
+  writeTime = 0;
+  thread = std::thread(&SnapshotWriter::run, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shouldStop = true;
+  }
+  condition.notify_one();
+  thread.join();
+}
+
+void SnapshotWriter::submit(std::shared_ptr<Snapshot> snapshot) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = snapshot;
+  }
+  condition.notify_one();
+}
+
+int SnapshotWriter::getNumWritten() {
+  return numWritten;
+}
+
+float SnapshotWriter::getWriteTime() {
+  return writeTime;
+}
+
+void SnapshotWriter::run() {
+  while (true) {
+    std::shared_ptr<Snapshot> snapshot;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] { return pending || shouldStop; });
+      if (!pending && shouldStop) {
+        return;
+      }
+      snapshot.swap(pending);
+    }
+
+    // Pending snapshot still goes out when stopping, it's the latest state.
+    auto start = ofGetElapsedTimeMicros();
+    if (snapshot->save(path)) {
+      numWritten++;
+    }
+    writeTime = (ofGetElapsedTimeMicros() - start) / 1000.f;
+  }
+}
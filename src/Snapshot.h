@@ -0,0 +1,96 @@
+// Binary snapshot of the simulation (bodies, joints, messages, bonds, memories) so a show
+// can pick up where it was after a crash or a reboot. The state is captured on the main
+// thread and written to disk by SnapshotWriter's thread.
+
+#pragma once
+#include "ofMain.h"
+#include "ofxBox2d.h"
+#include "Agent.h"
+
+struct BodyState {
+  b2Vec2 position; // Box2D units.
+  float angle;
+  b2Vec2 velocity;
+  float angularVelocity;
+  bool awake;
+};
+
+struct VertexState {
+  int meshIdx;
+  BodyState body;
+  bool applyRepulsion;
+  bool applyAttraction;
+  bool hasInterAgentJoint;
+  glm::vec2 targetPos;
+};
+
+struct AgentState {
+  string messageFile; // Which agent (amay.txt, azra.txt).
+  AgentProperties props;
+  std::vector<bool> refinedCells;
+  std::vector<VertexState> vertices;
+  std::shared_ptr<const MessageStore> messages; // Shared with the agent until they change.
+  int curMsg;
+  int partner; // Index in the snapshot, -1 for none.
+  int desireState;
+  glm::vec2 seekTargetPos;
+  bool applyStretch, applyTickle, applyAttraction, applyRepulsion;
+  float stretchWeight, repulsionWeight, tickleWeight;
+};
+
+struct JointState {
+  int agentA, meshIdxA;
+  int agentB, meshIdxB;
+  float length, frequency, damping;
+  uint64_t birth;
+};
+
+struct SuperAgentState {
+  int agentA, agentB;
+  float exchangeDelay, exchangeInterval; // Seconds to the next swap, between swaps.
+  std::vector<JointState> joints;
+};
+
+struct MemoryState {
+  glm::vec2 position, velocity;
+  float radius;
+  uint64_t elapsedTime, maxTime;
+};
+
+class Snapshot {
+  public:
+    bool save(string path);
+    bool load(string path);
+
+    static BodyState getBodyState(b2Body *body);
+    static void setBodyState(b2Body *body, const BodyState &state);
+
+    std::vector<AgentState> agents;
+    std::vector<SuperAgentState> superAgents;
+    std::vector<MemoryState> memories;
+    uint64_t jointCounter = 0;
+};
+
+// Writes the latest submitted snapshot on its own thread. If a write is still going
+// when a new one comes in, only the newest is kept.
+class SnapshotWriter {
+  public:
+    SnapshotWriter(string path);
+    ~SnapshotWriter();
+
+    void submit(std::shared_ptr<Snapshot> snapshot);
+    int getNumWritten();
+    float getWriteTime(); // ms, last write.
+
+  private:
+    void run();
+
+    string path;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::shared_ptr<Snapshot> pending;
+    bool shouldStop = false;
+    std::atomic<int> numWritten;
+    std::atomic<float> writeTime;
+};
@@ -0,0 +1,66 @@
+#include "SoftBodyPool.h"
+#include "JointPool.h"
+
+bool SoftBodyPool::acquire(const SoftBodyKey &key, b2World *world, SoftBodyLattice &lattice) {
+  for (int i = 0; i < lattices.size(); i++) {
+    if (lattices[i].world == world && lattices[i].key == key) {
+      lattice = std::move(lattices[i]);
+      lattices.erase(lattices.begin() + i);
+      numHits++;
+      return true;
+    }
+  }
+  
+  numMisses++;
+  return false;
+}
+
+bool SoftBodyPool::release(SoftBodyLattice &lattice) {
+  int numParked = 0;
+  for (auto &l : lattices) {
+    if (l.world == lattice.world && l.key == lattice.key) {
+      numParked++;
+    }
+  }
+  
+  if (numParked >= maxPerKey) {
+    return false;
+  }
+  
+  lattices.push_back(std::move(lattice));
+  return true;
+}
+
+void SoftBodyPool::clearWorld(b2World *world) {
+  ofRemove(lattices, [&](SoftBodyLattice &l) {
+    if (l.world != world) {
+      return false;
+    }
+    
+    for (auto &j : l.joints) {
+      world->DestroyJoint(j->joint);
+      JointPool::instance().release(j);
+    }
+    return true;
+  });
+}
+
+int SoftBodyPool::getNumParked() {
+  return lattices.size();
+}
+
+int SoftBodyPool::getNumHits() {
+  return numHits;
+}
+
+int SoftBodyPool::getNumMisses() {
+  return numMisses;
+}
+
+SoftBodyPool &SoftBodyPool::instance() {
+  return p;
+}
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+SoftBodyPool SoftBodyPool::p;
@@ -0,0 +1,53 @@
+// Pool of pre-built soft body lattices. Cleaning an agent parks its bodies and joints
+// here (inactive) instead of destroying them, and the next agent with the same
+// properties in the same world re-enables and repositions them instead of allocating.
+// Singleton like Midi.
+
+#pragma once
+#include "ofMain.h"
+#include "ofxBox2d.h"
+
+// Everything that defines the shape of the lattice.
+struct SoftBodyKey {
+  int rows = 0, cols = 0, interiorStep = 1;
+  float width = 0, height = 0;
+  float vertexRadius = 0;
+  ofPoint vertexPhysics;
+  ofPoint jointPhysics;
+  
+  bool operator==(const SoftBodyKey &other) const {
+    return rows == other.rows && cols == other.cols && interiorStep == other.interiorStep
+      && width == other.width && height == other.height && vertexRadius == other.vertexRadius
+      && vertexPhysics.x == other.vertexPhysics.x && vertexPhysics.y == other.vertexPhysics.y && vertexPhysics.z == other.vertexPhysics.z
+      && jointPhysics.x == other.jointPhysics.x && jointPhysics.y == other.jointPhysics.y;
+  }
+};
+
+struct SoftBodyLattice {
+  SoftBodyKey key;
+  b2World *world;
+  std::vector<std::shared_ptr<ofxBox2dCircle>> vertices;
+  std::vector<std::shared_ptr<ofxBox2dJoint>> joints;
+  std::vector<int> meshToBody;
+};
+
+class SoftBodyPool {
+  public:
+    bool acquire(const SoftBodyKey &key, b2World *world, SoftBodyLattice &lattice);
+    bool release(SoftBodyLattice &lattice); // False if the pool is full for this key.
+    void clearWorld(b2World *world); // Before the world goes away.
+  
+    int getNumParked();
+    int getNumHits();
+    int getNumMisses();
+  
+    static SoftBodyPool &instance();
+  
+  private:
+    std::vector<SoftBodyLattice> lattices;
+    int maxPerKey = 4; // Two agents per spawn, plus one spare pair.
+    int numHits = 0;
+    int numMisses = 0;
+  
+    static SoftBodyPool p;
+};
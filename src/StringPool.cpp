@@ -0,0 +1,38 @@
+#include "StringPool.h"
+
+StringId StringPool::intern(const string &s) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = ids.find(s);
+  if (it != ids.end()) {
+    return it->second;
+  }
+  
+  StringId id = strings.size();
+  strings.push_back(s);
+  ids[strings.back()] = id;
+  bytes += s.capacity();
+  return id;
+}
+
+const string &StringPool::get(StringId id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return strings[id];
+}
+
+int StringPool::getNumStrings() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return strings.size();
+}
+
+size_t StringPool::getBytes() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return bytes;
+}
+
+StringPool &StringPool::instance() {
+  return p;
+}
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+StringPool StringPool::p;
@@ -0,0 +1,28 @@
+// Interned strings. Every distinct text is stored once and messages carry its handle, so
+// swapping or copying a message never touches the string. Singleton like JointPool, since
+// both agents and snapshots resolve handles. Strings are never removed, handles stay valid.
+
+#pragma once
+#include "ofMain.h"
+#include <deque>
+
+typedef int StringId;
+
+class StringPool {
+  public:
+    StringId intern(const string &s);
+    const string &get(StringId id); // Safe from the snapshot writer's thread too.
+  
+    int getNumStrings();
+    size_t getBytes();
+  
+    static StringPool &instance();
+  
+  private:
+    std::mutex mutex;
+    std::deque<string> strings; // Deque, so references don't move when it grows.
+    std::unordered_map<std::string_view, StringId> ids; // Views into strings.
+    size_t bytes = 0;
+  
+    static StringPool p;
+};
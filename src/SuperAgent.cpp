@@ -3,84 +3,66 @@
 void SuperAgent::setup(Agent *agent1, Agent *agent2, std::shared_ptr<ofxBox2dJoint> joint) {
   agentA = agent1;
   agentB = agent2;
+  exchangeInterval = 20.f / 48; // Was a counter of 20 going down 0.8 a frame at 60 fps.
+  nextExchange = SimClock::instance().getTimeMillis(); // First swap right away.
+  addJoint(joint);
+}
+
+void SuperAgent::addJoint(std::shared_ptr<ofxBox2dJoint> joint) {
   joints.push_back(joint);
-  maxExchangeCounter = 20;
-  curExchangeCounter = 0;
-}
-
-void SuperAgent::update(ofxBox2d &box2d, std::vector<Memory> &memories, bool shouldBond, int maxJointForce) {
-  // Max Force based on which the joint breaks.
-  ofRemove(joints, [&](std::shared_ptr<ofxBox2dJoint> j) {
-    if (!shouldBond) {
-      box2d.getWorld()->DestroyJoint(j->joint);
-      // Get the bodies
-      auto bodyA = j->joint->GetBodyA();
-      auto bodyB = j->joint->GetBodyB();
-
-      // Update bodyA's data.
-      auto data = reinterpret_cast<VertexData*>(bodyA->GetUserData());
-      data->hasInterAgentJoint = false;
-      bodyA->SetUserData(data);
-
-      // Update bodyB's data.
-      data = reinterpret_cast<VertexData*>(bodyB->GetUserData());
-      data->hasInterAgentJoint = false;
-      bodyB->SetUserData(data);
-      
-      // Create a new memory object for each interAgentJoint and populate the vector.
-      glm::vec2 locA = getBodyPosition(bodyA);
-      glm::vec2 locB = getBodyPosition(bodyB);
-      glm::vec2 avgLoc = (locA + locB)/2;
-      
-      Memory mem(box2d, avgLoc);
-      memories.push_back(mem);
-
-      return true;
+  jointBirths.push_back(jointCounter++);
+  numJoints++;
+}
+
+void SuperAgent::update(ofxBox2d &box2d, FrameVector<glm::vec2> &memoryLocations, bool shouldBond, bool breakByForce, int maxJointForce, float invDt) {
+  // One pass after the step. All the joints go when the agents shouldn't bond anymore,
+  // else joints that are pulled harder than max force break on their own.
+  int numKept = 0;
+  for (int i = 0; i < joints.size(); i++) {
+    if (!shouldBond || (breakByForce && joints[i]->joint->GetReactionForce(invDt).Length() > maxJointForce)) {
+      memoryLocations.push_back(destroyJoint(joints[i], box2d));
     } else {
-      return false;
+      joints[numKept] = joints[i];
+      jointBirths[numKept] = jointBirths[i];
+      numKept++;
     }
-  });
+  }
+  joints.resize(numKept);
+  jointBirths.resize(numKept);
   
   if (joints.size() == 0) {
     shouldRemove = true;
-  } else {
-    // When it's a super agent, that means it's bonded.
-    // Check if it's ready to swap messages.
-    if (curExchangeCounter <= 0) {
-      std::vector<Message>::iterator aMessage = agentA -> curMsg;
-      std::vector<Message>::iterator bMessage = agentB -> curMsg;
-      
-      // Save the temp message.
-      Message swap = Message(aMessage->location, aMessage->color, aMessage->size, aMessage->message);
-      
-      // Assign A message
-      aMessage->color = bMessage->color;
-      aMessage->size = bMessage->size;
-      aMessage->message = bMessage->message;
-      
-      // Assign B message
-      bMessage->color = swap.color;
-      bMessage->size = swap.size;
-      bMessage->message = swap.message;
-      
-      // Change the iteretor to point to a unique message now
-      aMessage = agentA->messages.begin() + (int) ofRandom(0, agentA -> messages.size() - 1);
-      bMessage = agentB->messages.begin() + (int) ofRandom(0, agentB -> messages.size() - 1);
-      
-      // Update iterators for the swap.
-      agentA -> curMsg = aMessage;
-      agentB -> curMsg = bMessage;
-      
-      // Create new textures the two agents as they have just gone through a swap.
-      agentA->createTexture(agentA->getTextureSize());
-      agentB->createTexture(agentB->getTextureSize());
-      
-      // Reset exchange counter since
-      curExchangeCounter = maxExchangeCounter;
-    } else {
-      curExchangeCounter -= 0.8;
+  }
+}
+
+// When it's a super agent, that means it's bonded, so the agents swap messages.
+void SuperAgent::exchangeMessages(MessageSelection selection) {
+  nextExchange = SimClock::instance().getTimeMillis() + exchangeInterval * 1000;
+  auto &a = agentA->messages;
+  auto &b = agentB->messages;
+  
+  // Only text and color move, the layout stays. New text is fitted in its slot.
+  if (agentA->curMsg >= 0 && agentB->curMsg >= 0 && MessageStore::swap(a, agentA->curMsg, b, agentB->curMsg)) {
+    if (a.isText(agentA->curMsg)) {
+      agentA->fitText(agentA->curMsg);
+      agentB->fitText(agentB->curMsg);
     }
   }
+  
+  // Pick the next messages to swap, of the same kind.
+  agentA -> curMsg = a.pick(selection);
+  agentB -> curMsg = agentA->curMsg >= 0 ? b.pick(selection, a.isText(agentA->curMsg)) : -1;
+  if (agentB->curMsg < 0) {
+    // B doesn't have that kind, go with what B has.
+    agentB -> curMsg = b.pick(selection);
+    agentA -> curMsg = agentB->curMsg >= 0 ? a.pick(selection, b.isText(agentB->curMsg)) : -1;
+  }
+  agentA -> markMessagesDirty();
+  agentB -> markMessagesDirty();
+  
+  // Create new textures the two agents as they have just gone through a swap.
+  agentA->createTexture(agentA->getTextureSize());
+  agentB->createTexture(agentB->getTextureSize());
 }
 
 void SuperAgent::draw() {
@@ -93,32 +75,119 @@ void SuperAgent::draw() {
   }
 }
 
-// Check if super body already exists. 
+// Check if super body already exists (in either order).
 bool SuperAgent::contains(Agent *agent1, Agent *agent2) {
-  if (agent1 == agentA) {
-    if (agent2 == agentB) {
-      return true;
-    } else {
-      return false;
-    }
-  } else if (agent2 == agentB) {
-    if (agent1 == agentA) {
-      return true;
-    } else {
-      return false;
+  return (agent1 == agentA && agent2 == agentB) || (agent1 == agentB && agent2 == agentA);
+}
+
+// Destroy a single interAgentJoint. Returns the location for its memory.
+glm::vec2 SuperAgent::breakJoint(int idx, ofxBox2d &box2d) {
+  auto loc = destroyJoint(joints[idx], box2d);
+  joints.erase(joints.begin() + idx);
+  jointBirths.erase(jointBirths.begin() + idx);
+  return loc;
+}
+
+// Destroys the Box2D joint and returns the wrapper to the pool.
+glm::vec2 SuperAgent::destroyJoint(std::shared_ptr<ofxBox2dJoint> j, ofxBox2d &box2d) {
+  // Get the bodies (before the joint is gone).
+  auto bodyA = j->joint->GetBodyA();
+  auto bodyB = j->joint->GetBodyB();
+  box2d.getWorld()->DestroyJoint(j->joint);
+
+  // Update bodyA's data.
+  auto data = reinterpret_cast<VertexData*>(bodyA->GetUserData());
+  data->hasInterAgentJoint = false;
+  bodyA->SetUserData(data);
+
+  // Update bodyB's data.
+  data = reinterpret_cast<VertexData*>(bodyB->GetUserData());
+  data->hasInterAgentJoint = false;
+  bodyB->SetUserData(data);
+  
+  JointPool::instance().release(j);
+  numJoints--;
+  
+  glm::vec2 locA = getBodyPosition(bodyA);
+  glm::vec2 locB = getBodyPosition(bodyB);
+  return (locA + locB)/2;
+}
+
+// Joint carrying the least force. -1 if there are no joints.
+int SuperAgent::getWeakestJoint(float &force) {
+  int weakest = -1;
+  for (int i = 0; i < joints.size(); i++) {
+    auto f = joints[i]->joint->GetReactionForce(60.f).Length(); // Only used to rank, so any inverse time step works.
+    if (weakest < 0 || f < force) {
+      weakest = i; force = f;
     }
   }
+  
+  return weakest;
+}
+
+// Joint created first. -1 if there are no joints.
+int SuperAgent::getOldestJoint(unsigned long &birth) {
+  if (joints.size() == 0) {
+    return -1;
+  }
+  
+  // Joints are added in order.
+  birth = jointBirths[0];
+  return 0;
+}
+
+int SuperAgent::getNumJoints() {
+  return numJoints;
 }
 
 void SuperAgent::clean(ofxBox2d &box2d) {
   ofRemove(joints, [&](std::shared_ptr<ofxBox2dJoint> j){
     box2d.getWorld()->DestroyJoint(j->joint);
+    JointPool::instance().release(j);
+    numJoints--;
     return true;
   });
   
+  joints.clear();
+  jointBirths.clear();
+}
+
+void SuperAgent::detachJoints(ofxBox2d &box2d) {
+  detachedJoints.clear();
+  for (auto &j : joints) {
+    auto bodyA = j->joint->GetBodyA();
+    auto bodyB = j->joint->GetBodyB();
+    DetachedJoint d;
+    d.dataA = reinterpret_cast<VertexData*>(bodyA->GetUserData());
+    d.dataB = reinterpret_cast<VertexData*>(bodyB->GetUserData());
+    d.length = j->getLength();
+    d.frequency = j->getFrequency();
+    d.damping = j->getDamping();
+    detachedJoints.push_back(d);
+    
+    box2d.getWorld()->DestroyJoint(j->joint);
+    JointPool::instance().release(j);
+  }
+  
   joints.clear();
 }
 
+void SuperAgent::attachJoints(ofxBox2d &box2d) {
+  for (auto &d : detachedJoints) {
+    // Find the new bodies through the vertex data (it moved with the agents).
+    auto bodyA = d.dataA->agent->getBody(d.dataA->meshIdx);
+    auto bodyB = d.dataB->agent->getBody(d.dataB->meshIdx);
+    
+    auto j = JointPool::instance().acquire();
+    j->setup(box2d.getWorld(), bodyA, bodyB, d.frequency, d.damping);
+    j->setLength(d.length);
+    joints.push_back(j); // Same order as before, so jointBirths still match.
+  }
+  
+  detachedJoints.clear();
+}
+
 glm::vec2 SuperAgent::getBodyPosition(b2Body* body) {
   auto xf = body->GetTransform();
   b2Vec2 pos      = body->GetLocalCenter();
@@ -126,3 +195,24 @@ glm::vec2 SuperAgent::getBodyPosition(b2Body* body) {
   auto p = worldPtToscreenPt(b2Center);
   return glm::vec2(p.x, p.y);
 }
+
+// Restores a bond from a snapshot (VertexData flags come with the agents).
+void SuperAgent::restoreJoint(ofxBox2d &box2d, b2Body *bodyA, b2Body *bodyB, float length, float frequency, float damping, unsigned long birth) {
+  auto j = JointPool::instance().acquire();
+  j->setup(box2d.getWorld(), bodyA, bodyB, frequency, damping);
+  j->setLength(length);
+  joints.push_back(j);
+  jointBirths.push_back(birth);
+  numJoints++;
+}
+
+unsigned long SuperAgent::getJointCounter() {
+  return jointCounter;
+}
+
+void SuperAgent::setJointCounter(unsigned long counter) {
+  jointCounter = counter;
+}
+
+unsigned long SuperAgent::jointCounter = 0;
+int SuperAgent::numJoints = 0;
@@ -4,24 +4,85 @@
 #include "Agent.h"
 #include "Memory.h"
 #include "Midi.h"
+#include "FrameArena.h"
+#include "JointPool.h"
+#include "SimClock.h"
+
+// Key for the pair of bonded agents, independent of the order.
+struct AgentPair {
+  AgentPair(Agent *a, Agent *b) {
+    first = std::less<Agent*>()(a, b) ? a : b;
+    second = first == a ? b : a;
+  }
+  
+  bool operator==(const AgentPair &other) const {
+    return first == other.first && second == other.second;
+  }
+  
+  Agent *first;
+  Agent *second;
+};
+
+struct AgentPairHash {
+  std::size_t operator()(const AgentPair &p) const {
+    return std::hash<Agent*>()(p.first) ^ (std::hash<Agent*>()(p.second) << 1);
+  }
+};
 
 // Subsection body that is torn apart from the actual texture and falls on the ground.
 // The entire thing acts like one unique bond now. 
 class SuperAgent {
   public:
     void setup(Agent *agentA, Agent *agentB, std::shared_ptr<ofxBox2dJoint>);
-    void update(ofxBox2d &box2d, std::vector<Memory> &memories, bool shouldBond, int maxJointForce);
+    // Locations of the broken joints go in memoryLocations, ofApp makes the memories.
+    void update(ofxBox2d &box2d, FrameVector<glm::vec2> &memoryLocations, bool shouldBond, bool breakByForce, int maxJointForce, float invDt);
+    void exchangeMessages(MessageSelection selection); // Swap the current messages, on ofApp's exchange timer.
     void draw();
     bool contains(Agent *agentA, Agent *agentB);
     void clean(ofxBox2d &box2d);
+  
+    // Joint budget.
+    void addJoint(std::shared_ptr<ofxBox2dJoint> joint);
+    glm::vec2 breakJoint(int idx, ofxBox2d &box2d);
+    int getWeakestJoint(float &force);
+    int getOldestJoint(unsigned long &birth);
+    static int getNumJoints(); // Across all the pairs, kept up to date on create and break.
+  
+    // Shard migration. Joints are torn down before the agents move and
+    // recreated with the same properties in the new world after.
+    void detachJoints(ofxBox2d &box2d);
+    void attachJoints(ofxBox2d &box2d);
     glm::vec2 getBodyPosition(b2Body *body);
+  
+    // Snapshot
+    void restoreJoint(ofxBox2d &box2d, b2Body *bodyA, b2Body *bodyB, float length, float frequency, float damping, unsigned long birth);
+    static unsigned long getJointCounter();
+    static void setJointCounter(unsigned long counter);
     void createMemory();
   
     Agent *agentA;
     Agent *agentB;
     std::vector<std::shared_ptr<ofxBox2dJoint>> joints;  // These are interAgent joints.
+    std::vector<unsigned long> jointBirths; // Creation order of each joint (global).
     bool shouldRemove = false;
   
-    float curExchangeCounter;
-    float maxExchangeCounter;
+    // Message exchange, scheduled on ofApp's timer wheel.
+    float exchangeInterval; // Seconds between swaps.
+    unsigned long nextExchange; // Sim time (ms).
+    uint64_t exchangeTimer = 0; // Pending timer, so stale ones are ignored.
+  
+  private:
+    glm::vec2 destroyJoint(std::shared_ptr<ofxBox2dJoint> j, ofxBox2d &box2d);
+  
+    struct DetachedJoint {
+      VertexData *dataA;
+      VertexData *dataB;
+      float length;
+      float frequency;
+      float damping;
+    };
+    std::vector<DetachedJoint> detachedJoints;
+  
+    static unsigned long jointCounter;
+    static int numJoints;
 };
@@ -0,0 +1,78 @@
+#include "Telemetry.h"
+
+void Telemetry::setup(string host, int port) {
+  sender.setup(host, port);
+  isSetup = true;
+}
+
+void Telemetry::beginSection(string name) {
+  curSection = name;
+  sectionStart = ofGetElapsedTimeMicros();
+}
+
+void Telemetry::endSection() {
+  addTime(curSection, (ofGetElapsedTimeMicros() - sectionStart) / 1000.f);
+}
+
+void Telemetry::addTime(string name, float ms) {
+  times.push_back({name, ms});
+}
+
+void Telemetry::addCount(string name, int value) {
+  counts.push_back({name, value});
+}
+
+void Telemetry::addStates(string name, const std::vector<int> &values) {
+  states.push_back({name, values});
+}
+
+void Telemetry::send() {
+  if (isSetup) {
+    ofxOscBundle bundle;
+    ofxOscMessage m;
+    m.setAddress("/telemetry/frame");
+    m.addInt64Arg(ofGetFrameNum());
+    m.addFloatArg(ofGetLastFrameTime() * 1000.f);
+    m.addFloatArg(ofGetFrameRate());
+    bundle.addMessage(m);
+  
+    // One address per value, so the dashboard can plot them as they come.
+    for (auto &t : times) {
+      m.clear();
+      m.setAddress("/telemetry/time/" + t.first);
+      m.addFloatArg(t.second);
+      bundle.addMessage(m);
+    }
+  
+    for (auto &c : counts) {
+      m.clear();
+      m.setAddress("/telemetry/count/" + c.first);
+      m.addIntArg(c.second);
+      bundle.addMessage(m);
+    }
+  
+    for (auto &s : states) {
+      m.clear();
+      m.setAddress("/telemetry/state/" + s.first);
+      for (auto v : s.second) {
+        m.addIntArg(v);
+      }
+      bundle.addMessage(m);
+    }
+  
+    sender.sendBundle(bundle);
+    numSent++;
+  }
+  
+  clear();
+}
+
+void Telemetry::clear() {
+  times.clear();
+  counts.clear();
+  states.clear();
+}
+
+int Telemetry::getNumSent() {
+  return numSent;
+}
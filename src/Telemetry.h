@@ -0,0 +1,36 @@
+// Per frame stats (timings, counts, pools, desire states) sent to a dashboard over OSC,
+// so an installation can be watched without drawing the overlay. Everything collected
+// during a frame goes out as one bundle (one UDP packet) in send().
+
+#pragma once
+#include "ofMain.h"
+#include "ofxOsc.h"
+
+class Telemetry {
+  public:
+    void setup(string host, int port);
+  
+    // Times the code between the two calls.
+    void beginSection(string name);
+    void endSection();
+  
+    void addTime(string name, float ms);
+    void addCount(string name, int value);
+    void addStates(string name, const std::vector<int> &states);
+  
+    void send(); // Bundles this frame's values and starts a new frame.
+    void clear(); // Starts a new frame without sending.
+    int getNumSent();
+  
+  private:
+    ofxOscSender sender;
+    bool isSetup = false;
+    int numSent = 0;
+  
+    string curSection;
+    uint64_t sectionStart;
+  
+    std::vector<std::pair<string, float>> times;
+    std::vector<std::pair<string, int>> counts;
+    std::vector<std::pair<string, std::vector<int>>> states;
+};
@@ -0,0 +1,195 @@
+#include "TextureCache.h"
+
+TextureKey &TextureKey::add(const void *data, size_t bytes) {
+  auto b = (const unsigned char *) data;
+  for (size_t i = 0; i < bytes; i++) {
+    hash ^= b[i];
+    hash *= 1099511628211ULL;
+  }
+  return *this;
+}
+
+TextureKey &TextureKey::add(int v) {
+  return add(&v, sizeof(v));
+}
+
+TextureKey &TextureKey::add(float v) {
+  return add(&v, sizeof(v));
+}
+
+TextureKey &TextureKey::add(string v) {
+  // Length first, so ("ab", "c") and ("a", "bc") don't collide.
+  add((int) v.size());
+  return add(v.data(), v.size());
+}
+
+TextureKey &TextureKey::add(ofColor v) {
+  unsigned char rgba[4] = { v.r, v.g, v.b, v.a };
+  return add(rgba, 4);
+}
+
+TextureKey &TextureKey::add(glm::vec2 v) {
+  return add(v.x).add(v.y);
+}
+
+uint64_t TextureKey::getHash() const {
+  return hash;
+}
+
+// Raw file layout.
+struct TextureHeader {
+  char magic[4];
+  uint32_t width;
+  uint32_t height;
+  uint32_t channels;
+};
+
+bool TextureCache::load(const TextureKey &key, ofPixels &pixels) {
+  if (!enabled) {
+    return false;
+  }
+  
+  auto path = getPath(key);
+  std::ifstream file(path, std::ios::binary);
+  TextureHeader header;
+  if (!file.read((char *) &header, sizeof(header)) || strncmp(header.magic, "FGTX", 4) != 0) {
+    numMisses++;
+    return false;
+  }
+  
+  pixels.allocate(header.width, header.height, header.channels == 4 ? OF_PIXELS_RGBA : OF_PIXELS_RGB);
+  if (!file.read((char *) pixels.getData(), pixels.getTotalBytes())) {
+    // Truncated file, render it again.
+    pixels.clear();
+    numMisses++;
+    return false;
+  }
+  
+  numHits++;
+  touch(path, sizeof(header) + pixels.getTotalBytes());
+  return true;
+}
+
+void TextureCache::save(const TextureKey &key, const ofPixels &pixels) {
+  if (!enabled) {
+    return;
+  }
+  
+  ofDirectory::createDirectory("cache", true, true);
+  
+  // Write to a temporary file first, a half written file should never be read.
+  auto path = getPath(key);
+  auto tmpPath = path + ".tmp";
+  std::ofstream file(tmpPath, std::ios::binary);
+  TextureHeader header = { {'F', 'G', 'T', 'X'}, (uint32_t) pixels.getWidth(), (uint32_t) pixels.getHeight(), (uint32_t) pixels.getNumChannels() };
+  file.write((const char *) &header, sizeof(header));
+  file.write((const char *) pixels.getData(), pixels.getTotalBytes());
+  file.close();
+  
+  if (file) {
+    ofFile::moveFromTo(tmpPath, path, true, true);
+    touch(path, sizeof(header) + pixels.getTotalBytes());
+    evict();
+  } else {
+    ofLogWarning("TextureCache") << "Couldn't write " << path;
+    ofFile::removeFile(tmpPath, true);
+  }
+}
+
+void TextureCache::setEnabled(bool e) {
+  enabled = e;
+}
+
+bool TextureCache::isEnabled() {
+  return enabled;
+}
+
+int TextureCache::getNumHits() {
+  return numHits;
+}
+
+int TextureCache::getNumMisses() {
+  return numMisses;
+}
+
+float TextureCache::getHitRate() {
+  int total = numHits + numMisses;
+  return total == 0 ? 0 : (float) numHits / total;
+}
+
+void TextureCache::setMaxBytes(size_t bytes) {
+  maxBytes = bytes;
+  evict();
+}
+
+size_t TextureCache::getBytes() {
+  loadIndex();
+  return totalBytes;
+}
+
+int TextureCache::getNumEvicted() {
+  return numEvicted;
+}
+
+void TextureCache::loadIndex() {
+  if (indexLoaded) {
+    return;
+  }
+  indexLoaded = true;
+  
+  // Files from the last runs, oldest write last.
+  std::error_code error;
+  auto dir = ofToDataPath("cache", true);
+  std::vector<std::pair<std::filesystem::file_time_type, Entry>> files;
+  for (auto &f : std::filesystem::directory_iterator(dir, error)) {
+    if (f.path().extension() == ".rgba") {
+      files.push_back({f.last_write_time(error), {f.path().string(), (size_t) f.file_size(error)}});
+    }
+  }
+  std::sort(files.begin(), files.end(), [](auto &a, auto &b) { return a.first > b.first; });
+  for (auto &f : files) {
+    entries.push_back(f.second);
+    index[f.second.path] = std::prev(entries.end());
+    totalBytes += f.second.bytes;
+  }
+}
+
+void TextureCache::touch(const string &path, size_t bytes) {
+  loadIndex();
+  auto it = index.find(path);
+  if (it != index.end()) {
+    totalBytes -= it->second->bytes;
+    entries.erase(it->second);
+  }
+  entries.push_front({path, bytes});
+  index[path] = entries.begin();
+  totalBytes += bytes;
+  
+  // So the order survives a restart.
+  std::error_code error;
+  std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+}
+
+void TextureCache::evict() {
+  loadIndex();
+  while (totalBytes > maxBytes && entries.size() > 1) {
+    auto &oldest = entries.back();
+    ofFile::removeFile(oldest.path, false);
+    totalBytes -= oldest.bytes;
+    index.erase(oldest.path);
+    entries.pop_back();
+    numEvicted++;
+  }
+}
+
+string TextureCache::getPath(const TextureKey &key) {
+  return ofToDataPath("cache/" + ofToHex(key.getHash()) + ".rgba", true);
+}
+
+TextureCache &TextureCache::instance() {
+  return c;
+}
+
+// For a static class, variable needs to be
+// initialized in the implementation file.
+TextureCache TextureCache::c;
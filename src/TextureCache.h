@@ -0,0 +1,68 @@
+// Content addressed disk cache for generated textures (agent message textures, background).
+// Everything that goes into a texture is hashed into a key (palette, messages, sizes, filter
+// parameters, seed). The pixels are stored raw in data/cache/<key>.rgba so loading is a
+// single read, no decoding. The directory is capped (maxBytes), least recently used go first.
+
+#pragma once
+#include "ofMain.h"
+#include <filesystem>
+#include <list>
+
+// Builds the key. Add everything the texture depends on.
+class TextureKey {
+  public:
+    TextureKey &add(const void *data, size_t bytes);
+    TextureKey &add(int v);
+    TextureKey &add(float v);
+    TextureKey &add(string v);
+    TextureKey &add(ofColor v);
+    TextureKey &add(glm::vec2 v);
+  
+    uint64_t getHash() const;
+  
+  private:
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+};
+
+class TextureCache {
+  public:
+    bool load(const TextureKey &key, ofPixels &pixels);
+    void save(const TextureKey &key, const ofPixels &pixels);
+  
+    void setEnabled(bool enabled);
+    bool isEnabled();
+  
+    int getNumHits();
+    int getNumMisses();
+    float getHitRate(); // 0 - 1
+  
+    void setMaxBytes(size_t bytes);
+    size_t getBytes(); // On disk.
+    int getNumEvicted();
+  
+    static TextureCache &instance();
+  
+  private:
+    string getPath(const TextureKey &key);
+    void loadIndex(); // Scans the directory the first time.
+    void touch(const string &path, size_t bytes); // Most recently used.
+    void evict();
+  
+    bool enabled = true;
+    int numHits = 0;
+    int numMisses = 0;
+  
+    // Files in use order, most recent first.
+    struct Entry {
+      string path;
+      size_t bytes;
+    };
+    std::list<Entry> entries;
+    std::unordered_map<string, std::list<Entry>::iterator> index;
+    bool indexLoaded = false;
+    size_t totalBytes = 0;
+    size_t maxBytes = 256 * 1024 * 1024;
+    int numEvicted = 0;
+  
+    static TextureCache c;
+};
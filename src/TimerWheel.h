@@ -0,0 +1,123 @@
+// Hierarchical timer wheel on the sim clock (milliseconds). 4 levels of 256 slots: the first
+// holds the next 256 ms one slot per ms, each level above is 256 times coarser and its timers
+// cascade down as the time gets closer. Scheduling and cancelling are O(1), advancing costs
+// the ms that passed plus the timers that fire, not the number of timers waiting.
+// Header only (template), like FrameAllocator.
+
+#pragma once
+#include "ofMain.h"
+#include <unordered_set>
+
+template <typename T>
+class TimerWheel {
+  public:
+    typedef uint64_t TimerId;
+  
+    // Timers that are already due fire on the next advance.
+    TimerId schedule(uint64_t due, T payload) {
+      Timer timer{nextId++, std::max(due, time + 1), payload};
+      insert(timer);
+      numPending++;
+      return timer.id;
+    }
+  
+    void cancel(TimerId id) {
+      // Dropped when its slot comes up.
+      if (cancelled.insert(id).second) {
+        numPending--;
+      }
+    }
+  
+    // Calls fire(id, payload) for every timer due up to now, in time order.
+    template <typename F>
+    void advance(uint64_t now, F fire) {
+      while (time < now) {
+        if (numPending == 0) {
+          clear(now); // Nothing to fire (maybe cancelled ones), skip ahead.
+          break;
+        }
+        
+        time++;
+        int slot = time & mask;
+        // Wrapped around, bring the next range down from the level above.
+        for (int level = 1; level < numLevels; level++) {
+          int prev = (time >> (bits * (level - 1))) & mask;
+          if (prev != 0) {
+            break;
+          }
+          cascade(level, (time >> (bits * level)) & mask);
+        }
+        
+        // Timers can schedule new ones while firing.
+        std::vector<Timer> due;
+        due.swap(slots[0][slot]);
+        for (auto &t : due) {
+          if (isCancelled(t.id)) {
+            continue;
+          }
+          numPending--;
+          fire(t.id, t.payload);
+        }
+      }
+    }
+  
+    // Drops all the timers and starts counting from now.
+    void clear(uint64_t now) {
+      for (auto &level : slots) {
+        for (auto &slot : level) {
+          slot.clear();
+        }
+      }
+      cancelled.clear();
+      numPending = 0;
+      time = now;
+    }
+  
+    int size() {
+      return numPending;
+    }
+  
+  private:
+    struct Timer {
+      TimerId id;
+      uint64_t due;
+      T payload;
+    };
+  
+    static const int bits = 8;
+    static const int numSlots = 1 << bits;
+    static const int mask = numSlots - 1;
+    static const int numLevels = 4;
+  
+    void insert(Timer &timer) {
+      uint64_t delta = timer.due - time;
+      int level = 0;
+      while (level < numLevels - 1 && delta >= (uint64_t(1) << (bits * (level + 1)))) {
+        level++;
+      }
+      if (level == numLevels - 1 && delta >= (uint64_t(1) << (bits * numLevels))) {
+        timer.due = time + (uint64_t(1) << (bits * numLevels)) - 1; // Capped at ~50 days.
+      }
+      slots[level][(timer.due >> (bits * level)) & mask].push_back(timer);
+    }
+  
+    void cascade(int level, int slot) {
+      std::vector<Timer> timers;
+      timers.swap(slots[level][slot]);
+      for (auto &t : timers) {
+        if (!isCancelled(t.id)) {
+          insert(t);
+        }
+      }
+    }
+  
+    bool isCancelled(TimerId id) {
+      return !cancelled.empty() && cancelled.erase(id) > 0;
+    }
+  
+    std::vector<Timer> slots[numLevels][numSlots];
+    std::unordered_set<TimerId> cancelled;
+    uint64_t time = 0;
+    TimerId nextId = 1;
+    int numPending = 0;
+};
@@ -1,8 +1,29 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "MeshTopology.h"
+#include "SkylinePacker.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
+	// Headless benchmark of the position packing that feeds the mesh streams.
+	if (argc > 1 && std::string(argv[1]) == "--bench-packing") {
+		for (int n : {100, 400, 2500, 10000, 40000}) {
+			float us = GridMesh::benchmarkPacking(n, 1000);
+			std::cout << n << " vertices: " << us << " us/mesh" << std::endl;
+		}
+		return 0;
+	}
+
+	// Headless benchmark of the message layout (skyline packing).
+	if (argc > 1 && std::string(argv[1]) == "--bench-messages") {
+		for (int n : {100, 1000, 5000, 20000}) {
+			int numPlaced;
+			float us = SkylinePacker::benchmark(n, 20, numPlaced);
+			std::cout << n << " messages: " << us << " us/layout, " << numPlaced << " placed" << std::endl;
+		}
+		return 0;
+	}
+
 	ofSetupOpenGL(1024,768,OF_FULLSCREEN);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
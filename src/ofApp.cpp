@@ -4,6 +4,7 @@
 void ofApp::setup(){
   // Setup OSC
   receiver.setup(PORT);
+  numOscMessages = 0;
   //ofHideCursor();
   
   debugFont.load("opensansbond.ttf", 30);
@@ -14,15 +15,6 @@ void ofApp::setup(){
   ofEnableSmoothing();
   ofEnableAlphaBlending();
   
-  box2d.init();
-  box2d.setGravity(0, 0.0);
-  box2d.setFPS(60);
-  box2d.enableEvents();
-  box2d.registerGrabbing(); // Enable grabbing the circles.
-  
-  ofAddListener(box2d.contactStartEvents, this, &ofApp::contactStart);
-  ofAddListener(box2d.contactEndEvents, this, &ofApp::contactEnd);
-  
   // Setup gui.
   setupGui();
   
@@ -34,7 +26,9 @@ void ofApp::setup(){
   // Bounds
   bounds.x = -20; bounds.y = -20;
   bounds.width = ofGetWidth() + (-1) * bounds.x * 2; bounds.height = ofGetHeight() + (-1) * 2 * bounds.y;
-  box2d.createBounds(bounds);
+  
+  // Main physics world. More shards are created as agents spread out.
+  shards.push_back(std::make_unique<PhysicsShard>(bounds, false));
   
   enableSound = true;
   
@@ -43,10 +37,30 @@ void ofApp::setup(){
   
   
   // Store params and create background. 
-  bg.setParams(bgParams);
+  publishParams();
   bg.createBg();
   
   shouldBond = false; 
+  
+  // Joint wrappers for the inter agent bonds.
+  JointPool::instance().reserve(maxInterAgentJoints);
+  
+  // Physics stepping.
+  stepAccumulator = 0;
+  curVelocityIterations = velocityIterations;
+  curPositionIterations = positionIterations;
+  lastStepTime = 0;
+  lastSubsteps = 0;
+  
+  // Pick up where the last run left off.
+  snapshotWriter = std::make_unique<SnapshotWriter>(ofToDataPath("snapshot.bin", true));
+  lastSnapshotTime = 0;
+  nextMemoryId = 1;
+  if (restoreOnStart) {
+    restoreSnapshot();
+  }
+  
+  telemetry.setup(TELEMETRY_HOST, telemetryPort);
 }
 
 void ofApp::contactStart(ofxBox2dContactArgs &e) {
@@ -135,6 +149,10 @@ void ofApp::contactEnd(ofxBox2dContactArgs &e) {
             // Reset agent state to None on collision.
             agentB->setDesireState(None);
           }
+          
+          // Vertex flags are handled on the agents' next update.
+          agentA->wakeVertexBehaviors();
+          agentB->wakeVertexBehaviors();
 
           // Should the agents be evaluated for bonding?
           if (shouldBond) {
@@ -148,40 +166,80 @@ void ofApp::contactEnd(ofxBox2dContactArgs &e) {
 
 //--------------------------------------------------------------
 void ofApp::update(){
-  box2d.update();
+  // Release last frame's transient data.
+  FrameArena::instance().reset();
+  
+  telemetry.beginSection("step");
+  stepShards();
+  telemetry.endSection();
   processOsc();
   
   // Update super agents
-  ofRemove(superAgents, [&](SuperAgent &sa){
-    sa.update(box2d, memories, shouldBond, maxJointForce);
-    return sa.shouldRemove;
-  });
+  telemetry.beginSection("superAgents");
+  for (auto it = superAgents.begin(); it != superAgents.end();) {
+    auto &sa = it->second;
+    auto &box2d = getShard(sa.agentA)->box2d;
+    FrameVector<glm::vec2> memoryLocations;
+    sa.update(box2d, memoryLocations, shouldBond, breakByForce, maxJointForce, stepRate);
+    
+    // Create a new memory object for each removed interAgentJoint.
+    for (auto &loc : memoryLocations) {
+      addMemory(Memory(box2d, loc));
+    }
+    
+    if (sa.shouldRemove) {
+      exchangeTimers.cancel(sa.exchangeTimer);
+      it = superAgents.erase(it);
+    } else {
+      it = std::next(it);
+    }
+  }
+  telemetry.endSection();
+  
+  // Message exchanges and expired memories.
+  telemetry.beginSection("timers");
+  processTimers();
+  telemetry.endSection();
   
   // GUI props.
-  updateAgentProps();
+  if (paramsChanged) {
+    publishParams();
+  }
   
-  std::vector<ofMesh> meshes;
+  FrameVector<ofMesh *> meshes;
   // Update agents
+  telemetry.beginSection("agents");
   for (auto &a : agents) {
+    a -> setParams(params);
     a -> update();
-    meshes.push_back(a->getMesh());
+    meshes.push_back(&a->getMesh());
   }
+  telemetry.endSection();
   
   // Create super agents based on collision bodies.
   createSuperAgents();
   
+  // Merge/split physics worlds based on which agents can touch.
+  telemetry.beginSection("shards");
+  updateShards();
+  telemetry.endSection();
+  
   // Update background
+  telemetry.beginSection("background");
   bg.updateWithVertices(meshes);
+  telemetry.endSection();
   
-  // Update memories.
-  ofRemove(memories, [&](Memory &m) {
-    m.update();
-    return m.shouldRemove;
-  });
+  // Periodic snapshot, written on the writer's thread.
+  if (snapshotEnabled && ofGetElapsedTimef() - lastSnapshotTime > snapshotInterval) {
+    saveSnapshot();
+    lastSnapshotTime = ofGetElapsedTimef();
+  }
 }
 
 //--------------------------------------------------------------
 void ofApp::draw(){
+  telemetry.beginSection("draw");
+  
   // Draw background.
   if (!debug) {
    bg.draw();
@@ -197,8 +255,8 @@ void ofApp::draw(){
   ofPopStyle();
 
   // Draw all what's inside the super agents.
-  for (auto sa: superAgents) {
-    sa.draw();
+  for (auto &sa: superAgents) {
+    sa.second.draw();
   }
   
   // Draw Agent is the virtual method for derived class. 
@@ -214,15 +272,75 @@ void ofApp::draw(){
   // Health parameters
   if (hideGui) {
      ofDrawBitmapString(ofGetFrameRate(), 300, 50);
+     ofDrawBitmapString("Frame Arena: " + ofToString(FrameArena::instance().getUsed()/1024) + " KB / High Water: "
+        + ofToString(FrameArena::instance().getHighWaterMark()/1024) + " KB", 300, 70);
+     int numBodies = 0; int numJoints = 0;
+     for (auto &shard : shards) {
+       numBodies += shard->box2d.getWorld()->GetBodyCount();
+       numJoints += shard->box2d.getWorld()->GetJointCount();
+     }
+     ofDrawBitmapString("Bodies: " + ofToString(numBodies) + " Joints: " + ofToString(numJoints) + " Joint Pool: "
+        + ofToString(JointPool::instance().getNumFree()) + " / " + ofToString(JointPool::instance().getNumCreated()), 300, 90);
+     ofDrawBitmapString("Soft Body Pool: " + ofToString(SoftBodyPool::instance().getNumParked()) + " parked, "
+        + ofToString(SoftBodyPool::instance().getNumHits()) + " hits, " + ofToString(SoftBodyPool::instance().getNumMisses()) + " misses", 300, 150);
+     ofDrawBitmapString("Shards: " + ofToString(shards.size()) + " Step: " + ofToString(lastStepTime, 2) + " / "
+        + ofToString(stepBudget.get(), 2) + " ms", 300, 110);
+     ofDrawBitmapString("Substeps: " + ofToString(lastSubsteps) + " Iterations: " + ofToString((int) curVelocityIterations)
+        + " / " + ofToString((int) curPositionIterations) + " Sim Time: " + ofToString(SimClock::instance().getTime(), 1) + " s", 300, 130);
+     ofDrawBitmapString("Texture Cache: " + ofToString(TextureCache::instance().getNumHits()) + " hits, "
+        + ofToString(TextureCache::instance().getNumMisses()) + " misses (" + ofToString((int) (TextureCache::instance().getHitRate() * 100)) + "%), "
+        + ofToString(TextureCache::instance().getBytes()/1024/1024) + " MB, " + ofToString(TextureCache::instance().getNumEvicted()) + " evicted", 300, 170);
+     if (agents.size() > 0 && agents.back()->getSoftFilterChain()) {
+       // Last CPU rendered texture.
+       string times = "CPU Filters:";
+       for (auto f : agents.back()->getSoftFilterChain()->getFilters()) {
+         times += " " + f->getName() + " " + ofToString(f->getTime(), 2) + " ms";
+       }
+       ofDrawBitmapString(times, 300, 190);
+     }
+     size_t gpuBytes = 0; size_t cpuBytes = 0;
+     for (auto a : agents) {
+       gpuBytes += a->getGpuBytes();
+       cpuBytes += a->getCpuBytes();
+     }
+     int numAgents = std::max((int) agents.size(), 1);
+     ofDrawBitmapString("Textures: GPU " + ofToString(gpuBytes/numAgents/1024) + " KB, CPU " + ofToString(cpuBytes/numAgents/1024)
+        + " KB per agent. Fbo Pool: " + ofToString(FboPool::instance().getBytes()/1024) + " KB, " + ofToString(FboPool::instance().getNumFree())
+        + " free / " + ofToString(FboPool::instance().getNumCreated()), 300, 210);
+     ofDrawBitmapString("Background Tiles: " + ofToString(bg.getNumDirtyTiles()) + " / " + ofToString(bg.getNumTiles()) + " updated", 300, 230);
+     ofDrawBitmapString("Snapshots: " + ofToString(snapshotWriter->getNumWritten()) + " written, last write "
+        + ofToString(snapshotWriter->getWriteTime(), 2) + " ms", 300, 250);
+     ofDrawBitmapString("Telemetry: " + ofToString(telemetry.getNumSent()) + " packets sent", 300, 270);
+     float behaviorTime = 0;
+     for (auto a : agents) {
+       behaviorTime += a->getBehaviorTime();
+     }
+     int numBehaviors = 0;
+     for (auto a : agents) {
+       numBehaviors += a->getNumBehaviors();
+     }
+     ofDrawBitmapString("Behaviors: " + ofToString(numBehaviors) + " running, " + ofToString(behaviorTime, 3) + " ms ("
+        + (batchForces ? "batched" : "wrapper") + ")", 300, 290);
+     ofDrawBitmapString("Timers: " + ofToString(memoryTimers.size()) + " memories, " + ofToString(exchangeTimers.size()) + " exchanges", 300, 310);
+     int numTextMessages = 0;
+     for (auto a : agents) {
+       numTextMessages += a->getNumTextMessages();
+     }
+     ofDrawBitmapString("Messages: " + ofToString(numTextMessages) + " texts placed, " + ofToString(StringPool::instance().getNumStrings()) + " strings", 300, 330);
     gui.draw();
   }
+  
+  telemetry.endSection();
+  sendTelemetry();
 }
 
 void ofApp::processOsc() {
+  numOscMessages = 0;
   while(receiver.hasWaitingMessages()){
     // get the next message
     ofxOscMessage m;
     receiver.getNextMessage(m);
+    numOscMessages++;
     
     // ABLETON messages.
     // Process these OSC messages and based on which agent this needs to be delivered,
@@ -262,7 +380,7 @@ void ofApp::processOsc() {
       float val = m.getArgAsFloat(0);
       
       // Populate random agents
-      std::vector<Agent *> curAgents;
+      FrameVector<Agent *> curAgents;
       auto p = ofRandom(1);
         if (agents.size()>0) {
         if (p < 0.33) {
@@ -284,6 +402,31 @@ void ofApp::processOsc() {
       }
     }
     
+    // Physics stepping.
+    if(m.getAddress() == "/stepRate"){
+      stepRate = m.getArgAsFloat(0);
+    }
+    
+    if(m.getAddress() == "/substeps"){
+      maxSubsteps = (int) m.getArgAsFloat(0);
+    }
+    
+    if(m.getAddress() == "/velocityIterations"){
+      velocityIterations = (int) m.getArgAsFloat(0);
+    }
+    
+    if(m.getAddress() == "/positionIterations"){
+      positionIterations = (int) m.getArgAsFloat(0);
+    }
+    
+    if(m.getAddress() == "/adaptive"){
+      adaptiveIterations = m.getArgAsFloat(0) > 0;
+    }
+    
+    if(m.getAddress() == "/stepBudget"){
+      stepBudget = m.getArgAsFloat(0);
+    }
+    
     // STATE CHANGER!
     if(m.getAddress() == "/Melody"){
       float val = m.getArgAsFloat(0);
@@ -338,19 +481,56 @@ void ofApp::processOsc() {
   }
 }
 
-void ofApp::updateAgentProps() {
-    // Create Soft Body payload to create objects.
-  agentProps.meshDimensions = ofPoint(meshRows, meshColumns);
-  agentProps.meshSize = ofPoint(meshWidth, meshHeight);
-  agentProps.vertexRadius = vertexRadius;
-  agentProps.vertexPhysics = ofPoint(vertexBounce, vertexDensity, vertexFriction); // x (bounce), y (density), z (friction)
-  agentProps.jointPhysics = ofPoint(jointFrequency, jointDamping); // x (frequency), y (damping)
+void ofApp::publishParams() {
+  // Create Soft Body payload to create objects.
+  params.agent.meshDimensions = ofPoint(meshRows, meshColumns);
+  params.agent.meshSize = ofPoint(meshWidth, meshHeight);
+  params.agent.interiorStep = meshInteriorStep;
+  params.agent.cpuTexture = cpuTextures;
+  params.agent.vertexRadius = vertexRadius;
+  params.agent.vertexPhysics = ofPoint(vertexBounce, vertexDensity, vertexFriction); // x (bounce), y (density), z (friction)
+  params.agent.jointPhysics = ofPoint(jointFrequency, jointDamping); // x (frequency), y (damping)
+  
+  // Level of detail.
+  params.lod.enabled = lodEnabled;
+  params.lod.range = lodRange;
+  params.lod.frameInterval = lodFrameInterval;
+  params.lod.vertexStride = lodVertexStride;
+  params.lod.useProxy = lodProxy;
+  params.lod.proxyDelay = lodProxyDelay;
+  params.batchForces = batchForces;
+  params.limitInStep = limitInStep;
+  params.messageSelection = (MessageSelection) messageSelection.get();
+  
+  // Background.
+  params.bg.rectWidth = rectWidth;
+  params.bg.rectHeight = rectHeight;
+  params.bg.attraction = attraction;
+  params.bg.repulsion = repulsion;
+  params.bg.epsilon = bgEpsilon;
+  params.bg.cpuTexture = cpuTextures;
+  
+  params.version++;
+  paramsChanged = false;
+  
+  bg.setParams(params.bg);
+}
+
+void ofApp::paramChanged(ofAbstractParameter &param) {
+  // Picked up at the next update, so a slider drag publishes once per frame.
+  paramsChanged = true;
 }
 
 void ofApp::createAgents() {
+  auto shard = getShardForNewAgents();
+  
+  // Pick one of the cached texture layouts.
+  auto agentProps = params.agent;
+  agentProps.textureSeed = textureVariations > 0 ? (int) ofRandom(textureVariations) : -1;
+  
   // Create Amay & Azra
-  Amay *a = new Amay(box2d, agentProps);
-  Azra *b = new Azra(box2d, agentProps);
+  Amay *a = new Amay(shard->box2d, agentProps);
+  Azra *b = new Azra(shard->box2d, agentProps);
   
   // Set partners
   a->partner = b;
@@ -359,6 +539,8 @@ void ofApp::createAgents() {
   // Push agents in the array.
   agents.push_back(a);
   agents.push_back(b);
+  shard->agents.push_back(a);
+  shard->agents.push_back(b);
 }
 
 void ofApp::setupGui() {
@@ -371,6 +553,8 @@ void ofApp::setupGui() {
     meshParams.add(meshColumns.set("Mesh Columns", 5, 5, 100));
     meshParams.add(meshWidth.set("Mesh Width", 100, 10, ofGetWidth()));
     meshParams.add(meshHeight.set("Mesh Height", 100, 10, ofGetHeight()));
+    meshParams.add(meshInteriorStep.set("Interior Step", 1, 1, 10)); // 1 is a uniform grid, else coarse interior lattice.
+    meshParams.add(textureVariations.set("Texture Variations", 0, 0, 50)); // 0 is a random layout every time, else cached layouts.
   
     // Vertex parameters
     vertexParams.setName("Vertex Params");
@@ -388,7 +572,38 @@ void ofApp::setupGui() {
     interAgentJointParams.setName("InterAgentJoint Params");
     interAgentJointParams.add(frequency.set("Joint Frequency", 2.0f, 0.0f, 20.0f));
     interAgentJointParams.add(damping.set("Joint Damping", 1.0f, 0.0f, 10.0f));
+    interAgentJointParams.add(breakByForce.set("Break By Force", false));
     interAgentJointParams.add(maxJointForce.set("Max Joint Force", 6.f, 1.f, 100.0f));
+    interAgentJointParams.add(maxInterAgentJoints.set("Max Joints", 200, 1, 2000));
+    interAgentJointParams.add(maxJointsPerPair.set("Max Joints Per Pair", 50, 1, 500));
+    interAgentJointParams.add(evictWeakest.set("Evict Weakest", true));
+    interAgentJointParams.add(messageSelection.set("Message Selection", 0, 0, 2)); // Uniform, text first, least recently swapped.
+  
+    // Level of detail parameters
+    lodParams.setName("LOD Params");
+    lodParams.add(lodEnabled.set("Enable LOD", false));
+    lodParams.add(lodRange.set("Interaction Range", 3.f, 1.f, 10.f));
+    lodParams.add(lodFrameInterval.set("Far Frame Interval", 4, 1, 30));
+    lodParams.add(lodVertexStride.set("Far Vertex Stride", 3, 1, 10));
+    lodParams.add(lodProxy.set("Proxy Body", true));
+    lodParams.add(lodProxyDelay.set("Proxy Delay", 60, 1, 600)); // Frames far and idle before collapsing.
+  
+    // Physics stepping parameters
+    physicsParams.setName("Physics Params");
+    physicsParams.add(stepRate.set("Step Rate", 60.f, 30.f, 240.f)); // Hz
+    physicsParams.add(maxSubsteps.set("Max Substeps", 4, 1, 10));
+    physicsParams.add(velocityIterations.set("Velocity Iterations", 40, 1, 100)); // ofxBox2d defaults.
+    physicsParams.add(positionIterations.set("Position Iterations", 20, 1, 100));
+    physicsParams.add(adaptiveIterations.set("Adaptive Iterations", false));
+    physicsParams.add(stepBudget.set("Step Budget", 4.f, 0.5f, 16.f)); // ms
+    physicsParams.add(timeScale.set("Time Scale", 1.f, 0.1f, 8.f)); // Sim seconds per real second (up to max substeps).
+    physicsParams.add(batchForces.set("Batch Forces", true)); // Off goes through the ofxBox2d wrapper (to compare).
+    physicsParams.add(limitInStep.set("Limit Velocity In Step", false)); // After every substep, on the shard's thread.
+  
+    // Physics sharding parameters
+    shardParams.setName("Shard Params");
+    shardParams.add(maxShards.set("Max Shards", 1, 1, std::max(1u, std::thread::hardware_concurrency())));
+    shardParams.add(shardRange.set("Merge Range", 2.f, 1.f, 10.f)); // Multiple of the desire radii.
   
     // Background group
     bgParams.setName("Background Params");
@@ -397,17 +612,35 @@ void ofApp::setupGui() {
     bgParams.add(attraction.set("Attraction", 20, -200, 200));
     bgParams.add(repulsion.set("Repulsion", -20, -200, 200));
     bgParams.add(shaderScale.set("Scale", 1.f, 0.f, 10.f));
-    rectWidth.addListener(this, &ofApp::widthChanged);
-    rectHeight.addListener(this, &ofApp::heightChanged);
-    attraction.addListener(this, &ofApp::updateForce);
-    repulsion.addListener(this, &ofApp::updateForce);
-    shaderScale.addListener(this, &ofApp::updateParams);
+    bgParams.add(bgEpsilon.set("Epsilon", 0.5f, 0.f, 5.f)); // Displacement change (px) below which vertices aren't updated.
+    bgParams.add(cpuTextures.set("CPU Textures", false)); // Agents and background rendered without FBOs.
+  
+    // Snapshot group
+    snapshotParams.setName("Snapshot Params");
+    snapshotParams.add(snapshotEnabled.set("Enable Snapshots", false));
+    snapshotParams.add(snapshotInterval.set("Interval", 5.f, 1.f, 60.f)); // Seconds
+    snapshotParams.add(restoreOnStart.set("Restore On Start", false));
+  
+    // Telemetry group
+    telemetryParams.setName("Telemetry Params");
+    telemetryParams.add(telemetryEnabled.set("Enable Telemetry", false));
+    telemetryParams.add(telemetryPort.set("Port", 9000, 1024, 65535));
+    telemetryPort.addListener(this, &ofApp::telemetryPortChanged);
   
     settings.add(meshParams);
     settings.add(vertexParams);
     settings.add(jointParams);
     settings.add(interAgentJointParams);
+    settings.add(physicsParams);
+    settings.add(lodParams);
+    settings.add(shardParams);
     settings.add(bgParams);
+    settings.add(snapshotParams);
+    settings.add(telemetryParams);
+  
+    // Any change (nested groups too) republishes the typed params.
+    paramsChanged = true;
+    ofAddListener(settings.parameterChangedE(), this, &ofApp::paramChanged);
   
     gui.setup(settings);
     gui.loadFromFile("InterMesh.xml");
@@ -416,23 +649,31 @@ void ofApp::setupGui() {
 void ofApp::clearScreen() {
   // [WARNING] For some reason, these events are still fired when trying to clean things as one could be in the
     // middle of a step function. Disabling and renabling the events work as a good solution for now.
-  box2d.disableEvents();
+  for (auto &shard : shards) {
+    shard->box2d.disableEvents();
+  }
   collidingBodies.clear();
 
   // Clear SuperAgents
   for (auto &sa : superAgents) {
-    sa.clean(box2d);
+    sa.second.clean(getShard(sa.second.agentA)->box2d);
   }
   superAgents.clear();
+  exchangeTimers.clear(SimClock::instance().getTimeMillis());
 
   // Clean agents
   for (auto &a : agents) {
-    a -> clean(box2d);
+    a -> clean(getShard(a)->box2d);
+  }
+  for (auto &a : agents) {
     delete a;
   }
   agents.clear();
 
-  box2d.enableEvents();
+  for (auto &shard : shards) {
+    shard->agents.clear();
+    shard->box2d.enableEvents();
+  }
 }
 
 void ofApp::removeUnbonded() {
@@ -447,16 +688,20 @@ void ofApp::removeUnbonded() {
 }
 
 void ofApp::removeJoints() {
-  box2d.disableEvents();
+  for (auto &shard : shards) {
+    shard->box2d.disableEvents();
+  }
 
   // Clear superAgents only
   for (auto &sa : superAgents) {
-    sa.clean(box2d);
+    sa.second.clean(getShard(sa.second.agentA)->box2d);
   }
   superAgents.clear();
+  exchangeTimers.clear(SimClock::instance().getTimeMillis());
 
-  superAgents.clear();
-  box2d.enableEvents();
+  for (auto &shard : shards) {
+    shard->box2d.enableEvents();
+  }
 }
 
 //--------------------------------------------------------------
@@ -502,8 +747,184 @@ void ofApp::keyPressed(int key){
 }
 
 void ofApp::exit() {
-  box2d.disableEvents();
+  for (auto &shard : shards) {
+    shard->box2d.disableEvents();
+  }
   gui.saveToFile("InterMesh.xml");
+  
+  // Last one before quitting, the writer finishes it before it's destroyed.
+  if (snapshotEnabled) {
+    saveSnapshot();
+  }
+  snapshotWriter.reset();
+}
+
+void ofApp::sendTelemetry() {
+  if (!telemetryEnabled) {
+    // Drop this frame's timings.
+    telemetry.clear();
+    return;
+  }
+  
+  // Just the solver, the step section also has the accumulator and LOD bookkeeping.
+  telemetry.addTime("solver", lastStepTime);
+  float behaviorTime = 0;
+  for (auto a : agents) {
+    behaviorTime += a->getBehaviorTime();
+  }
+  telemetry.addTime("behaviors", behaviorTime);
+  int numBehaviors = 0;
+  for (auto a : agents) {
+    numBehaviors += a->getNumBehaviors();
+  }
+  telemetry.addCount("behaviors", numBehaviors);
+  
+  int numBodies = 0; int numJoints = 0;
+  for (auto &shard : shards) {
+    numBodies += shard->box2d.getWorld()->GetBodyCount();
+    numJoints += shard->box2d.getWorld()->GetJointCount();
+  }
+  telemetry.addCount("bodies", numBodies);
+  telemetry.addCount("joints", numJoints);
+  telemetry.addCount("interAgentJoints", getNumInterAgentJoints());
+  telemetry.addCount("agents", agents.size());
+  telemetry.addCount("superAgents", superAgents.size());
+  telemetry.addCount("memories", memories.size());
+  telemetry.addCount("strings", StringPool::instance().getNumStrings());
+  telemetry.addCount("memoryTimers", memoryTimers.size());
+  telemetry.addCount("exchangeTimers", exchangeTimers.size());
+  telemetry.addCount("shards", shards.size());
+  telemetry.addCount("substeps", lastSubsteps);
+  telemetry.addCount("oscQueue", numOscMessages);
+  
+  // Allocations.
+  telemetry.addCount("arenaUsed", FrameArena::instance().getUsed());
+  telemetry.addCount("arenaHighWater", FrameArena::instance().getHighWaterMark());
+  telemetry.addCount("arenaOverflows", FrameArena::instance().getOverflowCount());
+  telemetry.addCount("jointPoolFree", JointPool::instance().getNumFree());
+  telemetry.addCount("jointPoolCreated", JointPool::instance().getNumCreated());
+  telemetry.addCount("softBodyPoolParked", SoftBodyPool::instance().getNumParked());
+  telemetry.addCount("fboPoolFree", FboPool::instance().getNumFree());
+  telemetry.addCount("fboPoolCreated", FboPool::instance().getNumCreated());
+  telemetry.addCount("textureCacheMisses", TextureCache::instance().getNumMisses());
+  
+  std::vector<int> desires;
+  for (auto a : agents) {
+    desires.push_back(a->getDesireState());
+  }
+  telemetry.addStates("desire", desires);
+  
+  telemetry.send();
+}
+
+void ofApp::saveSnapshot() {
+  auto snapshot = std::make_shared<Snapshot>();
+  
+  // Agents are referenced by their index in the snapshot.
+  std::unordered_map<Agent *, int> indices;
+  for (int i = 0; i < agents.size(); i++) {
+    indices[agents[i]] = i;
+  }
+  
+  snapshot->agents.resize(agents.size());
+  for (int i = 0; i < agents.size(); i++) {
+    agents[i]->saveState(snapshot->agents[i]);
+    auto partner = indices.find(agents[i]->partner);
+    snapshot->agents[i].partner = partner != indices.end() ? partner->second : -1;
+  }
+  
+  for (auto &it : superAgents) {
+    auto &sa = it.second;
+    SuperAgentState state;
+    state.agentA = indices[sa.agentA];
+    state.agentB = indices[sa.agentB];
+    state.exchangeDelay = std::max(0.0, ((double) sa.nextExchange - SimClock::instance().getTimeMillis()) / 1000);
+    state.exchangeInterval = sa.exchangeInterval;
+    for (int i = 0; i < sa.joints.size(); i++) {
+      auto &j = sa.joints[i];
+      auto dataA = reinterpret_cast<VertexData*>(j->joint->GetBodyA()->GetUserData());
+      auto dataB = reinterpret_cast<VertexData*>(j->joint->GetBodyB()->GetUserData());
+      JointState joint;
+      joint.agentA = indices[dataA->agent];
+      joint.meshIdxA = dataA->meshIdx;
+      joint.agentB = indices[dataB->agent];
+      joint.meshIdxB = dataB->meshIdx;
+      joint.length = j->getLength();
+      joint.frequency = j->getFrequency();
+      joint.damping = j->getDamping();
+      joint.birth = sa.jointBirths[i];
+      state.joints.push_back(joint);
+    }
+    snapshot->superAgents.push_back(state);
+  }
+  
+  for (auto &m : memories) {
+    MemoryState state;
+    state.position = m.getPosition();
+    state.velocity = m.getVelocity();
+    state.radius = m.getRadius();
+    state.elapsedTime = m.getElapsedTime();
+    state.maxTime = m.getMaxTime();
+    snapshot->memories.push_back(state);
+  }
+  
+  snapshot->jointCounter = SuperAgent::getJointCounter();
+  snapshotWriter->submit(snapshot);
+}
+
+bool ofApp::restoreSnapshot() {
+  Snapshot snapshot;
+  if (!snapshot.load(ofToDataPath("snapshot.bin", true))) {
+    return false;
+  }
+  
+  clearScreen();
+  
+  // Everything goes in the main world, updateShards splits them again.
+  auto shard = shards[0].get();
+  std::vector<Agent *> restored;
+  for (auto &state : snapshot.agents) {
+    Agent *agent;
+    if (state.messageFile == "amay.txt") {
+      agent = new Amay(shard->box2d, state.props);
+    } else {
+      agent = new Azra(shard->box2d, state.props);
+    }
+    agent->restoreState(state);
+    restored.push_back(agent);
+    agents.push_back(agent);
+    shard->agents.push_back(agent);
+  }
+  
+  for (int i = 0; i < restored.size(); i++) {
+    int partner = snapshot.agents[i].partner;
+    restored[i]->partner = partner >= 0 ? restored[partner] : NULL;
+  }
+  
+  for (auto &state : snapshot.superAgents) {
+    SuperAgent sa;
+    sa.agentA = restored[state.agentA];
+    sa.agentB = restored[state.agentB];
+    sa.exchangeInterval = state.exchangeInterval;
+    sa.nextExchange = SimClock::instance().getTimeMillis() + state.exchangeDelay * 1000;
+    for (auto &j : state.joints) {
+      auto bodyA = restored[j.agentA]->getBody(j.meshIdxA);
+      auto bodyB = restored[j.agentB]->getBody(j.meshIdxB);
+      if (bodyA && bodyB) {
+        sa.restoreJoint(shard->box2d, bodyA, bodyB, j.length, j.frequency, j.damping, j.birth);
+      }
+    }
+    auto it = superAgents.emplace(AgentPair(sa.agentA, sa.agentB), sa).first;
+    scheduleExchange(it->second);
+  }
+  
+  for (auto &state : snapshot.memories) {
+    addMemory(Memory(shard->box2d, state.position, state.velocity, state.radius, state.elapsedTime, state.maxTime));
+  }
+  
+  SuperAgent::setJointCounter(snapshot.jointCounter);
+  ofLogNotice("ofApp") << "Restored " << agents.size() << " agents, " << superAgents.size() << " bonds from the snapshot";
+  return true;
 }
 
 // Massive important function that determines when the 2 bodies actually bond.
@@ -539,24 +960,8 @@ bool ofApp::canVertexBond(b2Body* body, Agent *curAgent) {
   return true;
 }
 
-void ofApp::widthChanged (int & newWidth) {
-  // New background
-  bg.setParams(bgParams);
-  bg.createBg();
-}
-
-void ofApp::heightChanged (int & newHeight) {
-  // New background
-  bg.setParams(bgParams);
-  bg.createBg();
-}
-
-void ofApp::updateParams(float & newVal) {
-  bg.setParams(bgParams);
-}
-
-void ofApp::updateForce(int & newVal) {
-  bg.setParams(bgParams);
+void ofApp::telemetryPortChanged(int & newPort) {
+  telemetry.setup(TELEMETRY_HOST, newPort);
 }
 
 glm::vec2 ofApp::getBodyPosition(b2Body* body) {
@@ -574,33 +979,122 @@ void ofApp::createSuperAgents() {
       auto agentA = reinterpret_cast<VertexData*>(collidingBodies[0]->GetUserData())->agent;
       auto agentB = reinterpret_cast<VertexData*>(collidingBodies[1]->GetUserData())->agent;
     
-      // If both the agents have that state, then they'll bond.
-      SuperAgent superAgent; bool found = false;
-      std::shared_ptr<ofxBox2dJoint> j;
-      // Check for existing joints.
-      for (auto &sa : superAgents) {
-        if (sa.contains(agentA, agentB)) {
-          j = createInterAgentJoint(collidingBodies[0], collidingBodies[1]);
-          sa.joints.push_back(j);
-          found = true;
+      // Existing bond between these agents? Make room if the pair is full.
+      auto it = superAgents.find(AgentPair(agentA, agentB));
+      if (it != superAgents.end() && it->second.joints.size() >= maxJointsPerPair) {
+        evictJoint(&it->second);
+      }
+    
+      // Stay under the global budget, so a bonding storm can't slow down the solver.
+      while (getNumInterAgentJoints() >= maxInterAgentJoints) {
+        if (!evictJoint(NULL)) {
+          break;
         }
       }
     
-      if (!found) {
-        j = createInterAgentJoint(collidingBodies[0], collidingBodies[1]);
+      // If both the agents have that state, then they'll bond.
+      auto j = createInterAgentJoint(collidingBodies[0], collidingBodies[1]);
+      if (it != superAgents.end()) {
+        it->second.addJoint(j);
+      } else {
+        SuperAgent superAgent;
         superAgent.setup(agentA, agentB, j); // Create a new super agent.
-        superAgents.push_back(superAgent);
+        auto created = superAgents.emplace(AgentPair(agentA, agentB), superAgent).first;
+        scheduleExchange(created->second);
       }
     
       collidingBodies.clear();
   }
 }
 
+int ofApp::getNumInterAgentJoints() {
+  return SuperAgent::getNumJoints(); // Running count, no walk over the pairs.
+}
+
+// Break the weakest (or oldest) bond of this pair, or of all the pairs when pair is NULL.
+// The broken bond leaves a memory behind, like any other broken bond.
+bool ofApp::evictJoint(SuperAgent *pair) {
+  SuperAgent *victim = NULL; int victimIdx = -1;
+  float minForce = 0; unsigned long minBirth = 0;
+  
+  for (auto &sa : superAgents) {
+    if (pair != NULL && &sa.second != pair) {
+      continue;
+    }
+    
+    if (evictWeakest) {
+      float force; int idx = sa.second.getWeakestJoint(force);
+      if (idx >= 0 && (victim == NULL || force < minForce)) {
+        victim = &sa.second; victimIdx = idx; minForce = force;
+      }
+    } else {
+      unsigned long birth; int idx = sa.second.getOldestJoint(birth);
+      if (idx >= 0 && (victim == NULL || birth < minBirth)) {
+        victim = &sa.second; victimIdx = idx; minBirth = birth;
+      }
+    }
+  }
+  
+  if (victim == NULL) {
+    return false;
+  }
+  
+  auto &box2d = getShard(victim->agentA)->box2d;
+  auto loc = victim->breakJoint(victimIdx, box2d);
+  addMemory(Memory(box2d, loc));
+  return true;
+}
+
+void ofApp::addMemory(Memory mem) {
+  mem.id = nextMemoryId++;
+  memoryIndices[mem.id] = memories.size();
+  memoryTimers.schedule(mem.getExpiry(), mem.id);
+  memories.push_back(mem);
+}
+
+void ofApp::removeMemory(uint64_t id) {
+  auto it = memoryIndices.find(id);
+  if (it == memoryIndices.end()) {
+    return;
+  }
+  
+  // Swap with the last one, order doesn't matter.
+  int idx = it->second;
+  memoryIndices.erase(it);
+  if (idx != memories.size() - 1) {
+    memories[idx] = memories.back();
+    memoryIndices[memories[idx].id] = idx;
+  }
+  memories.pop_back();
+}
+
+void ofApp::scheduleExchange(SuperAgent &sa) {
+  sa.exchangeTimer = exchangeTimers.schedule(sa.nextExchange, AgentPair(sa.agentA, sa.agentB));
+}
+
+void ofApp::processTimers() {
+  auto now = SimClock::instance().getTimeMillis();
+  memoryTimers.advance(now, [&](TimerWheel<uint64_t>::TimerId, uint64_t &id) {
+    removeMemory(id);
+  });
+  
+  exchangeTimers.advance(now, [&](TimerWheel<AgentPair>::TimerId timer, AgentPair &pair) {
+    // The pair could have been broken (and made again) since it was scheduled.
+    auto it = superAgents.find(pair);
+    if (it == superAgents.end() || it->second.exchangeTimer != timer) {
+      return;
+    }
+    
+    it->second.exchangeMessages(params.messageSelection);
+    scheduleExchange(it->second);
+  });
+}
+
 std::shared_ptr<ofxBox2dJoint> ofApp::createInterAgentJoint(b2Body *bodyA, b2Body *bodyB) {
-    auto j = std::make_shared<ofxBox2dJoint>();
+    auto j = JointPool::instance().acquire();
     float f = ofRandom(0.3, frequency);
     float d = ofRandom(1, damping);
-    j->setup(box2d.getWorld(), bodyA, bodyB, f, d); // Use the interAgentJoint props.
+    j->setup(bodyA->GetWorld(), bodyA, bodyB, f, d); // Use the interAgentJoint props.
   
     // Joint length
     int jointLength = ofRandom(250, 300);
@@ -610,10 +1104,250 @@ std::shared_ptr<ofxBox2dJoint> ofApp::createInterAgentJoint(b2Body *bodyA, b2Bod
     auto data = reinterpret_cast<VertexData*>(bodyA->GetUserData());
     data->hasInterAgentJoint = true;
     bodyA->SetUserData(data);
+    data->agent->refineAround(bodyA); // Full resolution around the bond.
   
     data = reinterpret_cast<VertexData*>(bodyB->GetUserData());
     data->hasInterAgentJoint = true;
     bodyB->SetUserData(data);
+    data->agent->refineAround(bodyB);
   
     return j;
 }
+
+void ofApp::stepShards() {
+  auto settings = getStepSettings();
+  
+  // Everything that ramps or counts down follows the stepped time.
+  SimClock::instance().advance(settings.substeps * settings.timeStep);
+  
+  // Step every world in parallel. Workers get going first, the inline (main)
+  // world steps on this thread while they run.
+  for (auto &shard : shards) {
+    if (shard->isThreaded()) {
+      shard->startStep(settings);
+    }
+  }
+  for (auto &shard : shards) {
+    if (!shard->isThreaded()) {
+      shard->startStep(settings);
+    }
+  }
+  
+  lastStepTime = 0;
+  for (auto &shard : shards) {
+    shard->waitForStep();
+    lastStepTime = std::max(lastStepTime, shard->stepTime);
+  }
+  
+  adaptIterations();
+  
+  // Contacts are handled on the main thread once all the steps are done.
+  for (auto &shard : shards) {
+    for (auto &e : shard->contacts) {
+      contactEnd(e);
+    }
+    shard->contacts.clear();
+  }
+}
+
+StepSettings ofApp::getStepSettings() {
+  StepSettings settings;
+  settings.timeStep = 1.f / stepRate;
+  
+  // Fixed timestep. Consume the frame time in whole steps, a long frame
+  // can't run more than max substeps (the rest is dropped).
+  stepAccumulator += ofGetLastFrameTime() * timeScale;
+  settings.substeps = std::min((int) (stepAccumulator / settings.timeStep), maxSubsteps.get());
+  stepAccumulator -= settings.substeps * settings.timeStep;
+  stepAccumulator = std::min(stepAccumulator, settings.timeStep);
+  lastSubsteps = settings.substeps;
+  
+  if (!adaptiveIterations) {
+    curVelocityIterations = velocityIterations;
+    curPositionIterations = positionIterations;
+  }
+  settings.velocityIterations = std::max(1, (int) curVelocityIterations);
+  settings.positionIterations = std::max(1, (int) curPositionIterations);
+  settings.limitVelocities = params.limitInStep;
+  
+  return settings;
+}
+
+void ofApp::adaptIterations() {
+  if (!adaptiveIterations) {
+    return;
+  }
+  
+  if (lastStepTime > stepBudget) {
+    // Over budget, back off quickly.
+    curVelocityIterations = std::max(1.f, curVelocityIterations * 0.8f);
+    curPositionIterations = std::max(1.f, curPositionIterations * 0.8f);
+  } else if (lastStepTime < stepBudget * 0.6) {
+    // Headroom, slowly raise back up to the configured iterations.
+    curVelocityIterations = std::min((float) velocityIterations, curVelocityIterations + 1);
+    curPositionIterations = std::min((float) positionIterations, curPositionIterations + 0.5f);
+  }
+}
+
+PhysicsShard *ofApp::getShard(Agent *agent) {
+  for (auto &shard : shards) {
+    if (ofContains(shard->agents, agent)) {
+      return shard.get();
+    }
+  }
+  
+  return shards[0].get();
+}
+
+PhysicsShard *ofApp::getShardForNewAgents() {
+  // New world if we have cores to spare, else the emptiest one.
+  if ((int) shards.size() < maxShards) {
+    shards.push_back(std::make_unique<PhysicsShard>(bounds, true));
+    return shards.back().get();
+  }
+  
+  PhysicsShard *emptiest = shards[0].get();
+  for (auto &shard : shards) {
+    if (shard->agents.size() < emptiest->agents.size()) {
+      emptiest = shard.get();
+    }
+  }
+  
+  return emptiest;
+}
+
+void ofApp::moveAgents(std::vector<Agent *> &group, PhysicsShard *from, PhysicsShard *to) {
+  from->box2d.disableEvents();
+  to->box2d.disableEvents();
+  
+  // Inter agent joints can only live in one world, so take them down first.
+  std::vector<SuperAgent *> movingSuperAgents;
+  for (auto &sa : superAgents) {
+    if (ofContains(group, sa.second.agentA) || ofContains(group, sa.second.agentB)) {
+      sa.second.detachJoints(from->box2d);
+      movingSuperAgents.push_back(&sa.second);
+    }
+  }
+  
+  for (auto &a : group) {
+    a->moveToWorld(to->box2d);
+    ofRemove(from->agents, [&](Agent *b) { return b == a; });
+    to->agents.push_back(a);
+  }
+  
+  for (auto &sa : movingSuperAgents) {
+    sa->attachJoints(to->box2d);
+  }
+  
+  from->box2d.enableEvents();
+  to->box2d.enableEvents();
+}
+
+// Islands of agents: partners, bonded agents and agents within range of each other
+// need to be in the same world. Islands that span worlds are merged, worlds that
+// contain multiple islands are split (while we have cores to spare).
+void ofApp::updateShards() {
+  if (agents.size() == 0 && shards.size() == 1) {
+    return;
+  }
+  
+  // Union find over the agents.
+  std::vector<int> parent(agents.size());
+  for (int i = 0; i < parent.size(); i++) {
+    parent[i] = i;
+  }
+  std::function<int(int)> find = [&](int i) {
+    return parent[i] == i ? i : (parent[i] = find(parent[i]));
+  };
+  auto unite = [&](Agent *a, Agent *b) {
+    auto i = std::find(agents.begin(), agents.end(), a) - agents.begin();
+    auto j = std::find(agents.begin(), agents.end(), b) - agents.begin();
+    if (i < agents.size() && j < agents.size()) {
+      parent[find(i)] = find(j);
+    }
+  };
+  
+  std::vector<PhysicsShard *> agentShards;
+  for (auto &a : agents) {
+    agentShards.push_back(getShard(a));
+    if (a->partner != NULL) {
+      unite(a, a->partner);
+    }
+  }
+  
+  for (auto &sa : superAgents) {
+    unite(sa.second.agentA, sa.second.agentB);
+  }
+  
+  for (int i = 0; i < agents.size(); i++) {
+    for (int j = i + 1; j < agents.size(); j++) {
+      auto d = glm::distance(agents[i]->getCentroid(), agents[j]->getCentroid());
+      auto range = (agents[i]->desireRadius + agents[j]->desireRadius) * shardRange;
+      // Already together, only split once they are clearly apart.
+      if (agentShards[i] == agentShards[j]) {
+        range *= 1.5;
+      }
+      if (d < range) {
+        parent[find(i)] = find(j);
+      }
+    }
+  }
+  
+  // Collect the islands.
+  std::map<int, std::vector<Agent *>> islands;
+  for (int i = 0; i < agents.size(); i++) {
+    islands[find(i)].push_back(agents[i]);
+  }
+  
+  // Merge islands that span multiple worlds into the world holding most of them.
+  for (auto &island : islands) {
+    std::map<PhysicsShard *, std::vector<Agent *>> parts;
+    for (auto &a : island.second) {
+      parts[getShard(a)].push_back(a);
+    }
+    
+    if (parts.size() > 1) {
+      PhysicsShard *target = parts.begin()->first;
+      for (auto &part : parts) {
+        if (part.second.size() > parts[target].size()) {
+          target = part.first;
+        }
+      }
+      
+      for (auto &part : parts) {
+        if (part.first != target) {
+          moveAgents(part.second, part.first, target);
+        }
+      }
+    }
+  }
+  
+  // Split worlds with multiple islands.
+  for (auto &island : islands) {
+    if ((int) shards.size() >= maxShards) {
+      break;
+    }
+    
+    auto shard = getShard(island.second[0]);
+    if (shard->agents.size() > island.second.size()) {
+      shards.push_back(std::make_unique<PhysicsShard>(bounds, true));
+      moveAgents(island.second, shard, shards.back().get());
+    }
+  }
+  
+  // Remove empty worlds once their memories are gone (keep the main one).
+  auto mainShard = shards[0].get();
+  ofRemove(shards, [&](std::unique_ptr<PhysicsShard> &shard) {
+    if (shard.get() == mainShard || shard->agents.size() > 0) {
+      return false;
+    }
+    
+    for (auto &m : memories) {
+      if (m.getWorld() == shard->box2d.getWorld()) {
+        return false;
+      }
+    }
+    
+    return true;
+  });
+}
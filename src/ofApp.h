@@ -11,8 +11,15 @@
 #include "Midi.h"
 #include "BgMesh.h"
 #include "Memory.h"
+#include "FrameArena.h"
+#include "PhysicsShard.h"
+#include "Snapshot.h"
+#include "Telemetry.h"
+#include "Params.h"
+#include "TimerWheel.h"
 
 #define PORT 8000
+#define TELEMETRY_HOST "127.0.0.1"
 
 class ofApp : public ofBaseApp{
 
@@ -24,7 +31,7 @@ class ofApp : public ofBaseApp{
     void setupGui();
     void createAgents();
     void clearAgents();
-    void updateAgentProps();
+    void publishParams();
   
     // Contact listening callbacks.
     void contactStart(ofxBox2dContactArgs &e);
@@ -40,12 +47,16 @@ class ofApp : public ofBaseApp{
     bool stopEverything;
     bool showTexture; 
   
-    // Box2d
-    ofxBox2d box2d;
+    // Box2d. One world per shard (island of agents that can touch).
+    std::vector<std::unique_ptr<PhysicsShard>> shards;
   
     // Agents
     std::vector<Agent *> agents;
-    AgentProperties agentProps;
+  
+    // Typed parameters, republished when the GUI changes.
+    Params params;
+    bool paramsChanged;
+    void paramChanged(ofAbstractParameter &param);
   
     // GUI
     ofxPanel gui;
@@ -57,6 +68,8 @@ class ofApp : public ofBaseApp{
     ofParameter<int> meshRows;
     ofParameter<int> meshWidth;
     ofParameter<int> meshHeight;
+    ofParameter<int> meshInteriorStep;
+    ofParameter<int> textureVariations;
   
     // Vertex group
     ofParameterGroup vertexParams;
@@ -74,25 +87,76 @@ class ofApp : public ofBaseApp{
     ofParameterGroup interAgentJointParams;
     ofParameter<float> frequency;
     ofParameter<float> damping;
+    ofParameter<bool> breakByForce;
     ofParameter<int> maxJointForce;
+    ofParameter<int> maxInterAgentJoints; // Global budget.
+    ofParameter<int> maxJointsPerPair;
+    ofParameter<bool> evictWeakest; // Else the oldest bond goes first.
+    ofParameter<int> messageSelection; // MessageSelection
+  
+    // Physics stepping
+    ofParameterGroup physicsParams;
+    ofParameter<float> stepRate;
+    ofParameter<int> maxSubsteps;
+    ofParameter<int> velocityIterations;
+    ofParameter<int> positionIterations;
+    ofParameter<bool> adaptiveIterations;
+    ofParameter<float> stepBudget;
+    ofParameter<float> timeScale;
+    ofParameter<bool> batchForces;
+    ofParameter<bool> limitInStep;
+  
+    // Physics sharding
+    ofParameterGroup shardParams;
+    ofParameter<int> maxShards;
+    ofParameter<float> shardRange;
+  
+    // Level of detail for agents far from any interaction.
+    ofParameterGroup lodParams;
+    ofParameter<bool> lodEnabled;
+    ofParameter<float> lodRange;
+    ofParameter<int> lodFrameInterval;
+    ofParameter<int> lodVertexStride;
+    ofParameter<bool> lodProxy;
+    ofParameter<int> lodProxyDelay;
   
     // Background group.
     ofParameterGroup bgParams;
     ofParameter<int> rectWidth;
     ofParameter<int> rectHeight;
-    // Callbacks to create new background. 
-    void widthChanged(int & newWidth);
-    void heightChanged(int & newHeight);
-    void updateForce(int & newVal);
-    void updateParams(float & newVal);
     ofParameter<int> attraction;
     ofParameter<int> repulsion;
     ofParameter<float> shaderScale;
+    ofParameter<bool> cpuTextures;
+    ofParameter<float> bgEpsilon;
+  
+    // Snapshot group.
+    ofParameterGroup snapshotParams;
+    ofParameter<bool> snapshotEnabled;
+    ofParameter<float> snapshotInterval;
+    ofParameter<bool> restoreOnStart;
+  
+    // Telemetry group.
+    ofParameterGroup telemetryParams;
+    ofParameter<bool> telemetryEnabled;
+    ofParameter<int> telemetryPort;
+    void telemetryPortChanged(int & newPort);
 
   private:
     std::vector<Memory> memories;
     std::vector<b2Body *> collidingBodies;
   
+    // Memory expiry and message exchanges, on the sim clock. Only the timers
+    // that fire cost anything in a frame.
+    void addMemory(Memory mem);
+    void removeMemory(uint64_t id);
+    void scheduleExchange(SuperAgent &sa);
+    void processTimers();
+    TimerWheel<uint64_t> memoryTimers; // Memory ids.
+    TimerWheel<AgentPair> exchangeTimers;
+    std::unordered_map<uint64_t, int> memoryIndices; // Id to index in memories.
+    uint64_t nextMemoryId;
+  
     // Helper methods.
     void processOsc();
     void clearScreen();
@@ -100,23 +164,45 @@ class ofApp : public ofBaseApp{
     void removeUnbonded();
     glm::vec2 getBodyPosition(b2Body* body);
   
+    // Shards
+    void stepShards();
+    StepSettings getStepSettings();
+    void adaptIterations();
+    void updateShards();
+    PhysicsShard *getShard(Agent *agent);
+    PhysicsShard *getShardForNewAgents();
+    void moveAgents(std::vector<Agent *> &group, PhysicsShard *from, PhysicsShard *to);
+  
+    // Snapshot (save and restore the whole installation).
+    void saveSnapshot();
+    bool restoreSnapshot();
+    std::unique_ptr<SnapshotWriter> snapshotWriter;
+    float lastSnapshotTime;
+  
     // Super Agents (Inter Agent Bonding Logic)
     void createSuperAgents();
     std::shared_ptr<ofxBox2dJoint> createInterAgentJoint(b2Body *bodyA, b2Body *bodyB);
     void evaluateBonding(b2Body* bodyA, b2Body* bodyB, Agent *agentA, Agent *agentB);
     bool canVertexBond(b2Body* body, Agent *curAgent);
+    int getNumInterAgentJoints();
+    bool evictJoint(SuperAgent *pair);
   
     // Serial
     ofSerial serial;
   
     // SuperAgents => These are abstract agents that have a bond with each other. 
-    std::vector<SuperAgent> superAgents;
+    std::unordered_map<AgentPair, SuperAgent, AgentPairHash> superAgents;
   
     // Bounds
     ofRectangle bounds;
   
     // OSC remote.
     ofxOscReceiver receiver;
+    int numOscMessages; // Drained this frame.
+  
+    // Stats for the dashboard.
+    Telemetry telemetry;
+    void sendTelemetry();
   
     // Background
     BgMesh bg;
@@ -124,4 +210,11 @@ class ofApp : public ofBaseApp{
     ofTrueTypeFont debugFont;
   
     bool shouldBond; 
+  
+    // Fixed timestep accumulator and the solver iterations in use (adaptive mode changes them).
+    float stepAccumulator;
+    float curVelocityIterations;
+    float curPositionIterations;
+    float lastStepTime;
+    int lastSubsteps;
 };